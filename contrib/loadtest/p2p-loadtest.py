@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+#
+# p2p-loadtest.py: Open many P2P connections to a local node and measure
+# ping/pong throughput and latency.
+#
+# Copyright (c) 2017 The PIVX developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+
+import argparse
+import hashlib
+import os
+import random
+import selectors
+import socket
+import struct
+import sys
+import time
+
+NETWORKS = {
+    # name: (message start, default port)
+    'main': (bytes([0xa8, 0x33, 0xfa, 0xf9]), 48766),
+    'test': (bytes([0xae, 0x0b, 0xfe, 0x07]), 48763),
+    'regtest': (bytes([0xbe, 0xbc, 0xb4, 0xd9]), 48764),
+}
+
+PROTOCOL_VERSION = 70913
+NODE_NETWORK = 1
+HEADER_SIZE = 24
+
+
+def sha256d(data):
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+
+def ser_string(s):
+    assert len(s) < 253
+    return struct.pack('<B', len(s)) + s
+
+
+def ser_address(host, port):
+    ip = socket.inet_pton(socket.AF_INET, host)
+    return struct.pack('<Q', NODE_NETWORK) + b'\x00' * 10 + b'\xff' * 2 + ip + struct.pack('>H', port)
+
+
+class Peer(object):
+    def __init__(self, test, sock):
+        self.test = test
+        self.sock = sock
+        self.recvbuf = b''
+        self.sendbuf = b''
+        self.ready = False
+        self.in_flight = {}
+
+    def message(self, command, payload=b''):
+        header = self.test.magic + struct.pack('<12sI', command, len(payload)) + sha256d(payload)[:4]
+        self.sendbuf += header + payload
+        self.test.sent += 1
+
+    def send_version(self):
+        payload = struct.pack('<iQq', PROTOCOL_VERSION, NODE_NETWORK, int(time.time()))
+        payload += ser_address(self.test.host, self.test.port)
+        payload += ser_address('127.0.0.1', 0)
+        payload += struct.pack('<Q', random.getrandbits(64))
+        payload += ser_string(b'/p2p-loadtest:0.1/')
+        payload += struct.pack('<i?', 0, False)
+        self.message(b'version', payload)
+
+    def send_ping(self):
+        nonce = random.getrandbits(64)
+        self.in_flight[nonce] = time.time()
+        self.message(b'ping', struct.pack('<Q', nonce))
+
+    def on_message(self, command, payload):
+        self.test.received += 1
+        if command == b'version':
+            self.message(b'verack')
+        elif command == b'verack':
+            self.ready = True
+            self.test.connected += 1
+            for i in range(self.test.args.in_flight):
+                self.send_ping()
+        elif command == b'ping':
+            self.message(b'pong', payload)
+        elif command == b'pong':
+            nonce, = struct.unpack('<Q', payload[:8])
+            start = self.in_flight.pop(nonce, None)
+            if start is not None:
+                self.test.latencies.append(time.time() - start)
+                self.test.pongs += 1
+                self.send_ping()
+
+    def on_readable(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise ConnectionError('connection closed by node')
+        self.recvbuf += data
+        while len(self.recvbuf) >= HEADER_SIZE:
+            if self.recvbuf[:4] != self.test.magic:
+                raise ConnectionError('bad message start')
+            command, length = struct.unpack('<12sI', self.recvbuf[4:20])
+            if len(self.recvbuf) < HEADER_SIZE + length:
+                break
+            payload = self.recvbuf[HEADER_SIZE:HEADER_SIZE + length]
+            self.recvbuf = self.recvbuf[HEADER_SIZE + length:]
+            self.on_message(command.rstrip(b'\x00'), payload)
+
+    def on_writable(self):
+        if self.sendbuf:
+            n = self.sock.send(self.sendbuf)
+            self.sendbuf = self.sendbuf[n:]
+
+
+class LoadTest(object):
+    def __init__(self, args):
+        self.args = args
+        self.magic, default_port = NETWORKS[args.network]
+        self.host = args.host
+        self.port = args.port or default_port
+        self.selector = selectors.DefaultSelector()
+        self.peers = []
+        self.connected = 0
+        self.failed = 0
+        self.sent = 0
+        self.received = 0
+        self.pongs = 0
+        self.latencies = []
+
+    def connect(self):
+        for i in range(self.args.connections):
+            sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            try:
+                sock.connect((self.host, self.port))
+            except OSError as e:
+                self.failed += 1
+                sock.close()
+                continue
+            sock.setblocking(False)
+            peer = Peer(self, sock)
+            peer.send_version()
+            self.peers.append(peer)
+            self.selector.register(sock, selectors.EVENT_READ | selectors.EVENT_WRITE, peer)
+
+    def drop(self, peer, reason):
+        self.failed += 1
+        if peer.ready:
+            self.connected -= 1
+        self.selector.unregister(peer.sock)
+        peer.sock.close()
+        self.peers.remove(peer)
+        if self.args.verbose:
+            print('dropped connection: %s' % reason, file=sys.stderr)
+
+    def run(self):
+        self.connect()
+        end = time.time() + self.args.duration
+        measure_start = None
+        while time.time() < end and self.peers:
+            # Start measuring once every connection finished its handshake
+            if measure_start is None and self.connected == len(self.peers):
+                measure_start = time.time()
+                self.sent = self.received = self.pongs = 0
+                self.latencies = []
+            for key, mask in self.selector.select(timeout=0.1):
+                peer = key.data
+                try:
+                    if mask & selectors.EVENT_READ:
+                        peer.on_readable()
+                    if mask & selectors.EVENT_WRITE:
+                        peer.on_writable()
+                except (OSError, ConnectionError) as e:
+                    self.drop(peer, e)
+        return time.time() - (measure_start or end)
+
+    def report(self, elapsed):
+        print('connections: %d established, %d failed' % (self.connected, self.failed))
+        if elapsed <= 0 or not self.latencies:
+            print('no pongs received')
+            return
+        lat = sorted(self.latencies)
+        pct = lambda p: lat[min(len(lat) - 1, int(p * len(lat)))] * 1000
+        print('messages: %.0f sent/s, %.0f received/s, %.0f round trips/s' % (
+            self.sent / elapsed, self.received / elapsed, self.pongs / elapsed))
+        print('ping latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f' % (
+            pct(0.50), pct(0.90), pct(0.99), lat[-1] * 1000))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='P2P connection load test against a local node')
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=0, help='default: the network\'s P2P port')
+    parser.add_argument('--network', choices=sorted(NETWORKS.keys()), default='regtest')
+    parser.add_argument('--connections', type=int, default=100)
+    parser.add_argument('--in-flight', type=int, default=1, help='pings kept outstanding per connection')
+    parser.add_argument('--duration', type=float, default=30, help='seconds to run')
+    parser.add_argument('--verbose', action='store_true')
+    args = parser.parse_args()
+
+    test = LoadTest(args)
+    elapsed = test.run()
+    test.report(elapsed)
+
+
+if __name__ == '__main__':
+    main()
@@ -82,6 +82,40 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         for tx in txs:
             assert_equal(tx in json_obj['tx'], True)
+
+        # headers are streamed in chunks and follow the active chain
+        json_string = http_get_call(url.hostname, url.port, '/rest/headers/5/'+bb_hash+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(len(json_obj), 2)
+        assert_equal(json_obj[0]['hash'], bb_hash)
+        assert_equal(json_obj[1]['hash'], newblockhash[0])
+        response = http_get_call(url.hostname, url.port, '/rest/headers/5/'+bb_hash+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        assert_equal(response.getheader('transfer-encoding'), 'chunked')
+        assert_equal(len(response.read()), 2*80)
+
+        # chain info
+        json_string = http_get_call(url.hostname, url.port, '/rest/chaininfo'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['bestblockhash'], newblockhash[0])
+
+        # getutxos: an output of a mined transaction is unspent, a made up one is not
+        tx_json = self.nodes[0].getrawtransaction(txs[0], 1)
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/'+txs[0]+'-0/'+'0'*64+'-0'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['chaintipHash'], newblockhash[0])
+        assert_equal(json_obj['bitmap'], '10')
+        assert_equal(json_obj['utxos'][0]['value'], tx_json['vout'][0]['value'])
+
+        # mempool contents
+        txid = self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), 1)
+        self.sync_all()
+        json_string = http_get_call(url.hostname, url.port, '/rest/mempool/contents'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(txid in json_obj, True)
+        json_string = http_get_call(url.hostname, url.port, '/rest/mempool/info'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['size'], 1)
                 
         
 
@@ -282,8 +282,8 @@ bool CActiveMasternode::Register(CTxIn vin, CService service, CKey keyCollateral
     if (pmn == NULL) {
         CMasternode mn(mnb);
         mnodeman.Add(mn);
-    } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+    } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+        mnodeman.UpdateIndexes(vin);
     }
 
     //send to all peers
@@ -380,6 +380,9 @@ vector<COutput> CActiveMasternode::SelectCoinsMasternode()
     vector<COutput> filteredCoins;
     vector<COutPoint> confLockedCoins;
 
+    // Unlocking re-checks whether the coins can stake, which needs the chain
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
     // Temporary unlock MN coins from masternode.conf
     if (GetBoolArg("-mnconflock", true)) {
         uint256 mnTxHash;
@@ -0,0 +1,40 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "pubkey.h"
+
+bool GetAddressIndexKey(const CScript& scriptPubKey, unsigned char& type, uint160& hashBytes)
+{
+    // Pay-to-pubkey outputs, as used by coinstakes, are indexed under the key's address
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return false;
+    return GetAddressIndexKey(dest, type, hashBytes);
+}
+
+bool GetAddressIndexKey(const CTxDestination& dest, unsigned char& type, uint160& hashBytes)
+{
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        type = ADDRESS_INDEX_PUBKEYHASH;
+        hashBytes = *keyID;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        type = ADDRESS_INDEX_SCRIPTHASH;
+        hashBytes = *scriptID;
+        return true;
+    }
+    return false;
+}
+
+CTxDestination GetAddressIndexDestination(unsigned char type, const uint160& hashBytes)
+{
+    if (type == ADDRESS_INDEX_PUBKEYHASH)
+        return CKeyID(hashBytes);
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return CScriptID(hashBytes);
+    return CNoDestination();
+}
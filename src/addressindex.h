@@ -0,0 +1,165 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Address types kept in the address index (-addressindex) */
+static const unsigned char ADDRESS_INDEX_NONE = 0;
+static const unsigned char ADDRESS_INDEX_PUBKEYHASH = 1;
+static const unsigned char ADDRESS_INDEX_SCRIPTHASH = 2;
+
+/** Heights and positions are stored big endian, so that LevelDB keeps an address's entries in chain order */
+template <typename Stream>
+inline void SerializeBE32(Stream& s, uint32_t n)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, n);
+    s.write((char*)buf, sizeof(buf));
+}
+
+template <typename Stream>
+inline uint32_t UnserializeBE32(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, sizeof(buf));
+    return ReadBE32(buf);
+}
+
+/**
+ * One credit or debit of an address: 'a', type, address hash, height, position of
+ * the transaction in its block, txid, output or input index, spending flag. The
+ * value is the amount, negative for spends.
+ */
+class CAddressIndexKey
+{
+public:
+    unsigned char type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey() : type(ADDRESS_INDEX_NONE), blockHeight(0), txindex(0), index(0), spending(false) {}
+    CAddressIndexKey(unsigned char typeIn, const uint160& hashBytesIn, int blockHeightIn, unsigned int txindexIn, const uint256& txhashIn, unsigned int indexIn, bool spendingIn) : type(typeIn),
+                                                                                                                                                                                   hashBytes(hashBytesIn),
+                                                                                                                                                                                   blockHeight(blockHeightIn),
+                                                                                                                                                                                   txindex(txindexIn),
+                                                                                                                                                                                   txhash(txhashIn),
+                                                                                                                                                                                   index(indexIn),
+                                                                                                                                                                                   spending(spendingIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 66;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        ::Serialize(s, hashBytes, nType, nVersion);
+        SerializeBE32(s, blockHeight);
+        SerializeBE32(s, txindex);
+        ::Serialize(s, txhash, nType, nVersion);
+        SerializeBE32(s, index);
+        ::Serialize(s, spending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, type, nType, nVersion);
+        ::Unserialize(s, hashBytes, nType, nVersion);
+        blockHeight = UnserializeBE32(s);
+        txindex = UnserializeBE32(s);
+        ::Unserialize(s, txhash, nType, nVersion);
+        index = UnserializeBE32(s);
+        ::Unserialize(s, spending, nType, nVersion);
+    }
+};
+
+/** An unspent output of an address: 'u', type, address hash, txid, output index */
+class CAddressUnspentKey
+{
+public:
+    unsigned char type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey() : type(ADDRESS_INDEX_NONE), index(0) {}
+    CAddressUnspentKey(unsigned char typeIn, const uint160& hashBytesIn, const uint256& txhashIn, unsigned int indexIn) : type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), index(indexIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 57;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        ::Serialize(s, hashBytes, nType, nVersion);
+        ::Serialize(s, txhash, nType, nVersion);
+        SerializeBE32(s, index);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, type, nType, nVersion);
+        ::Unserialize(s, hashBytes, nType, nVersion);
+        ::Unserialize(s, txhash, nType, nVersion);
+        index = UnserializeBE32(s);
+    }
+};
+
+/** What the address index remembers of an unspent output; a null value erases the entry */
+class CAddressUnspentValue
+{
+public:
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    CAddressUnspentValue() { SetNull(); }
+    CAddressUnspentValue(CAmount satoshisIn, const CScript& scriptIn, int blockHeightIn) : satoshis(satoshisIn), script(scriptIn), blockHeight(blockHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const { return satoshis == -1; }
+};
+
+/** Map an output script to its address index key; false if it pays to no single address */
+bool GetAddressIndexKey(const CScript& scriptPubKey, unsigned char& type, uint160& hashBytes);
+bool GetAddressIndexKey(const CTxDestination& dest, unsigned char& type, uint160& hashBytes);
+/** Inverse of GetAddressIndexKey */
+CTxDestination GetAddressIndexDestination(unsigned char type, const uint160& hashBytes);
+
+#endif // BITCOIN_ADDRESSINDEX_H
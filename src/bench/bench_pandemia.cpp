@@ -0,0 +1,24 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "init.h"
+#include "ui_interface.h"
+#include "util.h"
+
+CClientUIInterface uiInterface;
+CWallet* pwalletMain;
+
+int main(int argc, char** argv)
+{
+    SetupEnvironment();
+    SHA256AutoDetect();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::MAIN);
+
+    benchmark::BenchRunner::RunAll();
+}
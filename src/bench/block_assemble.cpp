@@ -0,0 +1,80 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "main.h"
+#include "miner.h"
+#include "random.h"
+#include "txmempool.h"
+#include "util.h"
+
+static const int BLOCK_ASSEMBLE_CHAINS = 10000;
+static const int BLOCK_ASSEMBLE_CHAIN_LENGTH = 5;
+
+// 50k transactions in chains of five with random fees, so a good share of the pool is packages.
+// The outputs the chains start from go into view.
+static void FillBenchMempool(CTxMemPool& pool, CCoinsViewCache& view)
+{
+    for (int i = 0; i < BLOCK_ASSEMBLE_CHAINS; i++) {
+        uint256 hashPrev = GetRandHash();
+        view.AddCoin(COutPoint(hashPrev, 0), Coin(CTxOut(10 * COIN, CScript() << OP_1), 1, false, false), false);
+        for (int j = 0; j < BLOCK_ASSEMBLE_CHAIN_LENGTH; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].scriptSig = CScript() << OP_1;
+            tx.vin[0].prevout = COutPoint(hashPrev, 0);
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_1;
+            tx.vout[0].nValue = 10 * COIN;
+            CAmount nFee = 1000 + GetRand(100000);
+            pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, GetTime(), 0.0, 1, 1));
+            hashPrev = tx.GetHash();
+        }
+    }
+}
+
+static void AssembleBlock(benchmark::State& state, bool fPriority)
+{
+    // Input checks look up the height of the view's best block
+    CBlockIndex indexTip;
+    uint256 hashTip = GetRandHash();
+    mapBlockIndex[hashTip] = &indexTip;
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    view.SetBestBlock(hashTip);
+    CTxMemPool pool(CFeeRate(0));
+    FillBenchMempool(pool, view);
+    if (!fPriority)
+        mapArgs["-blockprioritysize"] = "0";
+
+    {
+        LOCK(pool.cs);
+        while (state.KeepRunning()) {
+            CBlockTemplate blocktemplate;
+            AddMempoolTransactions(&blocktemplate, pool, &view, 1);
+        }
+    }
+
+    mapArgs.erase("-blockprioritysize");
+    mapBlockIndex.erase(hashTip);
+}
+
+// Template latency with the default priority area, which still visits the whole pool
+static void BlockAssemble50k(benchmark::State& state)
+{
+    AssembleBlock(state, true);
+}
+
+// Template latency with -blockprioritysize=0: package selection only
+static void BlockAssemble50kPackagesOnly(benchmark::State& state)
+{
+    AssembleBlock(state, false);
+}
+
+BENCHMARK(BlockAssemble50k);
+BENCHMARK(BlockAssemble50kPackagesOnly);
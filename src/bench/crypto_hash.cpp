@@ -0,0 +1,49 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+
+#include <vector>
+
+// Every benchmark hashes 1 MiB per iteration, so items/s is MiB/s
+static const size_t BUFFER_SIZE = 1 << 20;
+
+// Run with only the given SHA256 backend enabled; nothing is reported if the CPU lacks it
+static void SHA256Backend(benchmark::State& state, sha256_implementation::UseImplementation use, const char* tag, bool fD64)
+{
+    std::string impl = SHA256AutoDetect(use);
+    if (impl.find(tag) == std::string::npos || impl.find("self-test") != std::string::npos) {
+        SHA256AutoDetect();
+        return;
+    }
+
+    std::vector<unsigned char> in(BUFFER_SIZE, 0);
+    std::vector<unsigned char> out(BUFFER_SIZE / 2);
+    state.SetItemsPerIteration(1);
+    while (state.KeepRunning()) {
+        if (fD64) {
+            // As many 64-byte inputs as a merkle tree level of 16384 pairs
+            SHA256D64(&out[0], &in[0], BUFFER_SIZE / 64);
+        } else {
+            CSHA256().Write(&in[0], in.size()).Finalize(&out[0]);
+        }
+    }
+    SHA256AutoDetect();
+}
+
+static void SHA256_standard(benchmark::State& state) { SHA256Backend(state, sha256_implementation::STANDARD, "standard", false); }
+static void SHA256_shani(benchmark::State& state) { SHA256Backend(state, sha256_implementation::USE_SHANI, "shani", false); }
+static void SHA256D64_standard(benchmark::State& state) { SHA256Backend(state, sha256_implementation::STANDARD, "standard", true); }
+static void SHA256D64_sse41(benchmark::State& state) { SHA256Backend(state, sha256_implementation::USE_SSE4, "sse41", true); }
+static void SHA256D64_avx2(benchmark::State& state) { SHA256Backend(state, sha256_implementation::USE_AVX2, "avx2", true); }
+static void SHA256D64_shani(benchmark::State& state) { SHA256Backend(state, sha256_implementation::USE_SHANI, "shani", true); }
+
+BENCHMARK(SHA256_standard);
+BENCHMARK(SHA256_shani);
+BENCHMARK(SHA256D64_standard);
+BENCHMARK(SHA256D64_sse41);
+BENCHMARK(SHA256D64_avx2);
+BENCHMARK(SHA256D64_shani);
@@ -0,0 +1,81 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "main.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "timedata.h"
+#include "version.h"
+
+static const int MASTERNODE_RANK_CHAIN_LENGTH = 200;
+static const int MASTERNODE_RANK_LIST_SIZE = 5000;
+
+// A synthetic chain to score against and a list of enabled masternodes, torn down when it goes out of scope
+class MasternodeRankSetup
+{
+public:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vBlocks;
+    std::vector<CTxIn> vVins;
+    CMasternodeMan mnman;
+
+    MasternodeRankSetup() : vHashes(MASTERNODE_RANK_CHAIN_LENGTH), vBlocks(MASTERNODE_RANK_CHAIN_LENGTH)
+    {
+        for (int i = 0; i < MASTERNODE_RANK_CHAIN_LENGTH; i++) {
+            vHashes[i] = GetRandHash();
+            vBlocks[i].phashBlock = &vHashes[i];
+            vBlocks[i].pprev = i ? &vBlocks[i - 1] : NULL;
+            vBlocks[i].nHeight = i;
+            mapBlockIndex.insert(std::make_pair(vHashes[i], &vBlocks[i]));
+        }
+        chainActive.SetTip(&vBlocks.back());
+
+        for (int i = 0; i < MASTERNODE_RANK_LIST_SIZE; i++) {
+            CMasternode mn;
+            mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+            mn.protocolVersion = PROTOCOL_VERSION;
+            mn.sigTime = GetAdjustedTime() - 24 * 60 * 60;
+            mn.lastPing.vin = mn.vin;
+            mn.lastPing.sigTime = GetAdjustedTime();
+            mn.unitTest = true;
+            mnman.Add(mn);
+            vVins.push_back(mn.vin);
+        }
+    }
+
+    ~MasternodeRankSetup()
+    {
+        chainActive.SetTip(NULL);
+        for (int i = 0; i < MASTERNODE_RANK_CHAIN_LENGTH; i++)
+            mapBlockIndex.erase(vHashes[i]);
+    }
+};
+
+// Rank one masternode against freshly computed scores, the cost every vote paid before scores were cached
+static void MasternodeRankUncached(benchmark::State& state)
+{
+    MasternodeRankSetup setup;
+    const int64_t nBlockHeight = MASTERNODE_RANK_CHAIN_LENGTH - 100;
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        setup.mnman.InvalidateRankings();
+        setup.mnman.GetMasternodeRank(setup.vVins[i++ % setup.vVins.size()], nBlockHeight);
+    }
+}
+
+// Rank lookups for the same height, as payment and SwiftTX votes do
+static void MasternodeRankCached(benchmark::State& state)
+{
+    MasternodeRankSetup setup;
+    const int64_t nBlockHeight = MASTERNODE_RANK_CHAIN_LENGTH - 100;
+    size_t i = 0;
+    setup.mnman.GetMasternodeRank(setup.vVins[0], nBlockHeight);
+    while (state.KeepRunning())
+        setup.mnman.GetMasternodeRank(setup.vVins[i++ % setup.vVins.size()], nBlockHeight);
+}
+
+BENCHMARK(MasternodeRankUncached);
+BENCHMARK(MasternodeRankCached);
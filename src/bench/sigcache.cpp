@@ -0,0 +1,108 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// Script check threads looking up the signatures of a block at the same time
+static const int LOOKUP_THREADS = 16;
+static const int LOOKUPS_PER_THREAD = 4096;
+
+// A cache of the default -maxsigcachesize, half full, queried for an even mix of
+// cached and unknown signatures
+static const size_t CACHE_BYTES = 32 << 20;
+
+static std::vector<uint256> RandomDigests(size_t n)
+{
+    std::vector<uint256> v(n);
+    for (size_t i = 0; i < n; i++)
+        v[i] = GetRandHash();
+    return v;
+}
+
+static void CuckooLookups(CCuckooCache* cache, const std::vector<uint256>* digests, size_t nBegin)
+{
+    for (size_t i = nBegin; i < nBegin + LOOKUPS_PER_THREAD; i++)
+        cache->Contains((*digests)[i], false);
+}
+
+static void RunCuckoo(benchmark::State& state, int nThreads)
+{
+    CCuckooCache cache;
+    size_t nCapacity = cache.Setup(CACHE_BYTES);
+    std::vector<uint256> digests = RandomDigests(nThreads * LOOKUPS_PER_THREAD);
+    for (size_t i = 0; i < digests.size(); i += 2)
+        cache.Insert(digests[i]);
+    std::vector<uint256> fill = RandomDigests(nCapacity / 2 - digests.size() / 2);
+    for (size_t i = 0; i < fill.size(); i++)
+        cache.Insert(fill[i]);
+
+    state.SetItemsPerIteration((int64_t)digests.size());
+    while (state.KeepRunning()) {
+        boost::thread_group threads;
+        for (int t = 0; t < nThreads; t++)
+            threads.create_thread(boost::bind(&CuckooLookups, &cache, &digests, (size_t)t * LOOKUPS_PER_THREAD));
+        threads.join_all();
+    }
+}
+
+// The cache as it was before: a set of entries behind a reader/writer lock
+struct LockedSetCache {
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_sigcache;
+
+    bool Contains(const uint256& digest)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.count(digest) != 0;
+    }
+};
+
+static void LockedSetLookups(LockedSetCache* cache, const std::vector<uint256>* digests, size_t nBegin)
+{
+    for (size_t i = nBegin; i < nBegin + LOOKUPS_PER_THREAD; i++)
+        cache->Contains((*digests)[i]);
+}
+
+static void SigCacheLookup16Threads(benchmark::State& state)
+{
+    RunCuckoo(state, LOOKUP_THREADS);
+}
+
+static void SigCacheLookup1Thread(benchmark::State& state)
+{
+    RunCuckoo(state, 1);
+}
+
+static void SigCacheLockedSetLookup16Threads(benchmark::State& state)
+{
+    // The old cache held 50000 entries by default
+    LockedSetCache cache;
+    std::vector<uint256> digests = RandomDigests(LOOKUP_THREADS * LOOKUPS_PER_THREAD);
+    for (size_t i = 0; i < digests.size(); i += 2)
+        cache.setValid.insert(digests[i]);
+    std::vector<uint256> fill = RandomDigests(50000 - digests.size() / 2);
+    cache.setValid.insert(fill.begin(), fill.end());
+
+    state.SetItemsPerIteration((int64_t)digests.size());
+    while (state.KeepRunning()) {
+        boost::thread_group threads;
+        for (int t = 0; t < LOOKUP_THREADS; t++)
+            threads.create_thread(boost::bind(&LockedSetLookups, &cache, &digests, (size_t)t * LOOKUPS_PER_THREAD));
+        threads.join_all();
+    }
+}
+
+BENCHMARK(SigCacheLookup16Threads);
+BENCHMARK(SigCacheLookup1Thread);
+BENCHMARK(SigCacheLockedSetLookup16Threads);
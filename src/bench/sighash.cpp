@@ -0,0 +1,53 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+
+// A dust sweep or reward consolidation spending this many pay-to-pubkey-hash outputs
+static const unsigned int CONSOLIDATION_INPUTS = 200;
+
+static CTransaction ConsolidationTransaction(CScript& scriptCode)
+{
+    scriptCode = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CMutableTransaction tx;
+    for (unsigned int i = 0; i < CONSOLIDATION_INPUTS; i++) {
+        CTxIn txin(COutPoint(GetRandHash(), 0));
+        txin.scriptSig = CScript() << std::vector<unsigned char>(72, 2) << std::vector<unsigned char>(33, 3);
+        tx.vin.push_back(txin);
+    }
+    tx.vout.push_back(CTxOut(CONSOLIDATION_INPUTS * COIN, scriptCode));
+    return tx;
+}
+
+// Signature hashes of every input, as the script checks of the transaction compute them
+static void SighashConsolidation(benchmark::State& state)
+{
+    CScript scriptCode;
+    CTransaction tx = ConsolidationTransaction(scriptCode);
+    state.SetItemsPerIteration(CONSOLIDATION_INPUTS);
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL);
+    }
+}
+
+static void SighashConsolidationPrecomputed(benchmark::State& state)
+{
+    CScript scriptCode;
+    CTransaction tx = ConsolidationTransaction(scriptCode);
+    state.SetItemsPerIteration(CONSOLIDATION_INPUTS);
+    while (state.KeepRunning()) {
+        PrecomputedTransactionData txdata(tx);
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL, &txdata);
+    }
+}
+
+BENCHMARK(SighashConsolidation);
+BENCHMARK(SighashConsolidationPrecomputed);
@@ -0,0 +1,52 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "kernel.h"
+#include "main.h"
+#include "random.h"
+
+#include <boost/thread.hpp>
+
+static const int KERNEL_SEARCH_CHAIN_LENGTH = 200;
+static const int KERNEL_SEARCH_CANDIDATES = 10000;
+
+// Search 10k coins over the full hash drift with an unreachable target, so every
+// timestamp of every candidate is hashed; items/s is kernel hashes per second.
+static void StakeKernelSearch(benchmark::State& state)
+{
+    // A short synthetic chain, long enough that every candidate block has a stake modifier
+    std::vector<uint256> vHashes(KERNEL_SEARCH_CHAIN_LENGTH);
+    std::vector<CBlockIndex> vBlocks(KERNEL_SEARCH_CHAIN_LENGTH);
+    for (int i = 0; i < KERNEL_SEARCH_CHAIN_LENGTH; i++) {
+        vHashes[i] = GetRandHash();
+        vBlocks[i].phashBlock = &vHashes[i];
+        vBlocks[i].pprev = i ? &vBlocks[i - 1] : NULL;
+        vBlocks[i].nHeight = i;
+        vBlocks[i].nTime = 1500000000 + i * 60;
+        vBlocks[i].nFlags = CBlockIndex::BLOCK_STAKE_MODIFIER;
+        vBlocks[i].nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        mapBlockIndex.insert(std::make_pair(vHashes[i], &vBlocks[i]));
+    }
+    chainActive.SetTip(&vBlocks.back());
+
+    CStakeKernelSearch search;
+    for (int i = 0; i < KERNEL_SEARCH_CANDIDATES; i++)
+        search.AddCandidate(&vBlocks[i % (KERNEL_SEARCH_CHAIN_LENGTH / 4)], COutPoint(GetRandHash(), i), 100 * COIN);
+
+    const unsigned int nHashDrift = 45;
+    size_t nFound;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+    state.SetItemsPerIteration((int64_t)search.Size() * nHashDrift);
+    while (state.KeepRunning())
+        search.Search(0, vBlocks.back().nTime, nHashDrift, 0, boost::thread::hardware_concurrency(), nFound, nTimeTx, hashProofOfStake);
+
+    chainActive.SetTip(NULL);
+    for (int i = 0; i < KERNEL_SEARCH_CHAIN_LENGTH; i++)
+        mapBlockIndex.erase(vHashes[i]);
+}
+
+BENCHMARK(StakeKernelSearch);
@@ -0,0 +1,148 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "hash.h"
+#include "random.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <limits>
+#include <map>
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+                                                                            header(block.GetBlockHeader()),
+                                                                            vchBlockSig(block.vchBlockSig)
+{
+    FillShortTxIDSelector();
+
+    // The coinbase, and the coinstake of a PoS block, are never in anyone's mempool
+    size_t nPrefilled = block.IsProofOfStake() ? 2 : 1;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        if (i < nPrefilled)
+            prefilledtxn.push_back(PrefilledTransaction(i, block.vtx[i]));
+        else
+            shorttxids.push_back(GetShortID(block.vtx[i].GetHash()));
+    }
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CHashWriter ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header << nonce;
+    uint256 hashSelector = ss.GetHash();
+    shorttxidk0 = hashSelector.Get64(0);
+    shorttxidk1 = hashSelector.Get64(1);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffULL;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool)
+{
+    if (cmpctblock.header.IsNull() || cmpctblock.prefilledtxn.empty())
+        return READ_STATUS_INVALID;
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_SIZE / MIN_TRANSACTION_SIZE)
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && txn_available.empty());
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    txn_available.resize(cmpctblock.BlockTxCount());
+    vHave.assign(cmpctblock.BlockTxCount(), false);
+
+    for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
+        uint32_t index = cmpctblock.prefilledtxn[i].index;
+        if (index >= txn_available.size() || vHave[index])
+            return READ_STATUS_INVALID;
+        txn_available[index] = cmpctblock.prefilledtxn[i].tx;
+        vHave[index] = true;
+    }
+    prefilled_count = cmpctblock.prefilledtxn.size();
+
+    // Short ids fill the positions the prefilled transactions left free, in order
+    std::map<uint64_t, uint32_t> mapShortIDs;
+    uint32_t index = 0;
+    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++, index++) {
+        while (vHave[index])
+            index++;
+        // Two transactions of the block share a short id, only the full block can tell them apart
+        if (!mapShortIDs.insert(std::make_pair(cmpctblock.shorttxids[i], index)).second)
+            return READ_STATUS_FAILED;
+    }
+
+    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it) {
+        std::map<uint64_t, uint32_t>::iterator itID = mapShortIDs.find(cmpctblock.GetShortID(it->first));
+        if (itID == mapShortIDs.end())
+            continue;
+        if (!vHave[itID->second]) {
+            txn_available[itID->second] = it->second.GetTx();
+            vHave[itID->second] = true;
+            mempool_count++;
+        } else {
+            // Two mempool transactions match the same short id, request it from the peer instead
+            txn_available[itID->second] = CTransaction();
+            vHave[itID->second] = false;
+            mempool_count--;
+            mapShortIDs.erase(itID);
+        }
+        if (mempool_count == mapShortIDs.size())
+            break;
+    }
+
+    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n",
+        header.GetHash().ToString(), ::GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    assert(!header.IsNull());
+    return index < vHave.size() && vHave[index];
+}
+
+std::vector<uint32_t> PartiallyDownloadedBlock::GetMissing() const
+{
+    std::vector<uint32_t> vMissing;
+    for (size_t i = 0; i < vHave.size(); i++) {
+        if (!vHave[i])
+            vMissing.push_back(i);
+    }
+    return vMissing;
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing) const
+{
+    assert(!header.IsNull());
+    block = CBlock(header);
+    block.vtx.resize(txn_available.size());
+
+    size_t nMissingOffset = 0;
+    for (size_t i = 0; i < txn_available.size(); i++) {
+        if (vHave[i]) {
+            block.vtx[i] = txn_available[i];
+        } else {
+            if (nMissingOffset >= vtx_missing.size())
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vtx_missing[nMissingOffset++];
+        }
+    }
+    if (nMissingOffset != vtx_missing.size())
+        return READ_STATUS_INVALID;
+    block.vchBlockSig = vchBlockSig;
+
+    // A short id that matched the wrong mempool transaction shows up as a merkle root mismatch
+    bool fMutated = false;
+    if (block.BuildMerkleTree(&fMutated) != header.hashMerkleRoot || fMutated)
+        return READ_STATUS_FAILED;
+
+    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool and %lu txn requested\n",
+        header.GetHash().ToString(), prefilled_count, mempool_count, vtx_missing.size());
+
+    return READ_STATUS_OK;
+}
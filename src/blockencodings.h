@@ -0,0 +1,188 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+
+#include <vector>
+
+class CTxMemPool;
+
+/** Compact block protocol version announced in "sendcmpct" */
+static const uint64_t COMPACT_BLOCKS_PROTOCOL = 1;
+/** Smallest possible serialized transaction, bounds the number of transactions in a block */
+static const unsigned int MIN_TRANSACTION_SIZE = 60;
+
+/** A transaction sent in full inside a compact block, together with its position in the block */
+class PrefilledTransaction
+{
+public:
+    uint32_t index;
+    CTransaction tx;
+
+    PrefilledTransaction() : index(0) {}
+    PrefilledTransaction(uint32_t indexIn, const CTransaction& txIn) : index(indexIn), tx(txIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(VARINT(index));
+        READWRITE(tx);
+    }
+};
+
+/**
+ * A block announced as its header, the block signature and 6 byte short ids of its
+ * transactions. The coinbase and the coinstake are always sent in full, since the
+ * receiver cannot have them in its mempool; everything else is looked up in the
+ * receiver's mempool by short id.
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+public:
+    static const int SHORTTXIDS_LENGTH = 6;
+
+    CBlockHeader header;
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+    std::vector<unsigned char> vchBlockSig;
+
+    CBlockHeaderAndShortTxIDs() : shorttxidk0(0), shorttxidk1(0), nonce(0) {}
+    explicit CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return ::GetSerializeSize(header, nType, nVersion) + sizeof(nonce) +
+               GetSizeOfCompactSize(shorttxids.size()) + shorttxids.size() * SHORTTXIDS_LENGTH +
+               ::GetSerializeSize(prefilledtxn, nType, nVersion) +
+               ::GetSerializeSize(vchBlockSig, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, header, nType, nVersion);
+        ::Serialize(s, nonce, nType, nVersion);
+        WriteCompactSize(s, shorttxids.size());
+        for (size_t i = 0; i < shorttxids.size(); i++) {
+            uint32_t lsb = shorttxids[i] & 0xffffffff;
+            uint16_t msb = (shorttxids[i] >> 32) & 0xffff;
+            ::Serialize(s, lsb, nType, nVersion);
+            ::Serialize(s, msb, nType, nVersion);
+        }
+        ::Serialize(s, prefilledtxn, nType, nVersion);
+        ::Serialize(s, vchBlockSig, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, header, nType, nVersion);
+        ::Unserialize(s, nonce, nType, nVersion);
+        uint64_t nShortTxIDs = ReadCompactSize(s);
+        if (nShortTxIDs > MAX_BLOCK_SIZE / MIN_TRANSACTION_SIZE)
+            throw std::ios_base::failure("compact block has too many short ids");
+        shorttxids.resize(nShortTxIDs);
+        for (size_t i = 0; i < shorttxids.size(); i++) {
+            uint32_t lsb;
+            uint16_t msb;
+            ::Unserialize(s, lsb, nType, nVersion);
+            ::Unserialize(s, msb, nType, nVersion);
+            shorttxids[i] = (uint64_t(msb) << 32) | uint64_t(lsb);
+        }
+        ::Unserialize(s, prefilledtxn, nType, nVersion);
+        ::Unserialize(s, vchBlockSig, nType, nVersion);
+        FillShortTxIDSelector();
+    }
+};
+
+/** Request for the transactions of a compact block that could not be found in the mempool */
+class BlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    std::vector<uint32_t> indexes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(indexes);
+    }
+};
+
+/** Answer to a BlockTransactionsRequest, transactions in the order they were requested */
+class BlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    BlockTransactions() {}
+    BlockTransactions(const BlockTransactionsRequest& req) : blockhash(req.blockhash), txn(req.indexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+enum ReadStatus {
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //!< Invalid object, peer is sending bogus data
+    READ_STATUS_FAILED,  //!< Failed to reconstruct, fall back to downloading the full block
+};
+
+/** A block being rebuilt from a compact block, the mempool and a missing transactions round trip */
+class PartiallyDownloadedBlock
+{
+private:
+    std::vector<CTransaction> txn_available;
+    std::vector<bool> vHave;
+    size_t prefilled_count;
+    size_t mempool_count;
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+public:
+    PartiallyDownloadedBlock() : prefilled_count(0), mempool_count(0) {}
+
+    /** Fill in what the compact block and the pool provide. Requires pool.cs. */
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool);
+    bool IsTxAvailable(size_t index) const;
+    /** Indexes of the transactions still missing after InitData */
+    std::vector<uint32_t> GetMissing() const;
+    /** Complete the block with the missing transactions, in GetMissing order */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing) const;
+
+    bool IsNull() const { return header.IsNull(); }
+    uint256 GetBlockHash() const { return header.GetHash(); }
+    size_t GetPrefilledCount() const { return prefilled_count; }
+    size_t GetMempoolCount() const { return mempool_count; }
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
@@ -395,16 +395,21 @@ class CDiskBlockIndex : public CBlockIndex
 public:
     uint256 hashPrev;
     uint256 hashNext;
+    //! Header hash, when already known. Not serialized: the block tree database
+    //! stores it as the record key, so loading never needs to recompute it.
+    uint256 hashBlock;
 
     CDiskBlockIndex()
     {
         hashPrev = uint256();
         hashNext = uint256();
+        hashBlock = uint256();
     }
 
     explicit CDiskBlockIndex(CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        hashBlock = (phashBlock ? *phashBlock : uint256());
     }
 
     ADD_SERIALIZE_METHODS;
@@ -450,6 +455,14 @@ public:
     }
 
     uint256 GetBlockHash() const
+    {
+        if (!hashBlock.IsNull())
+            return hashBlock;
+        return CalculateBlockHash();
+    }
+
+    /** Recompute the header hash from the stored header fields (runs the full Quark chain). */
+    uint256 CalculateBlockHash() const
     {
         CBlockHeader block;
         block.nVersion = nVersion;
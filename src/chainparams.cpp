@@ -172,7 +172,7 @@ public:
         fMineBlocksOnDemand = false;
         fSkipProofOfWorkCheck = false;
         fTestnetToBeDeprecatedFieldRPC = false;
-        fHeadersFirstSyncingActive = false;
+        fHeadersFirstSyncingActive = true;
 
         nPoolMaxTransactions = 3;
         strSporkKey = "04ef26df7af7420c42673eeaee7976b85c98427e7255402a2a03f0bd57a55c62fa41e46d8c1a39e389f63f5ec2df5d69dbd9f5a4d756fc0e3e84d40eb0b2c734f8";
@@ -0,0 +1,129 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/quark.h"
+
+#include "crypto/sph_blake.h"
+#include "crypto/sph_bmw.h"
+#include "crypto/sph_groestl.h"
+#include "crypto/sph_jh.h"
+#include "crypto/sph_keccak.h"
+#include "crypto/sph_skein.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define USE_QUARK_X86 1
+namespace quark_x86
+{
+bool Supported();
+void Groestl512_64(const unsigned char* in, unsigned char* out);
+void JH512_64(const unsigned char* in, unsigned char* out);
+}
+#endif
+
+namespace
+{
+/** A 512-bit hash of a 64-byte input, the only size hashed after the first step. */
+typedef void (*Hash512_64)(const unsigned char* in, unsigned char* out);
+
+#define QUARK_SPH_HASH(name)                                             \
+    void name##512_64(const unsigned char* in, unsigned char* out)      \
+    {                                                                    \
+        sph_##name##512_context ctx;                                     \
+        sph_##name##512_init(&ctx);                                      \
+        sph_##name##512(&ctx, in, 64);                                   \
+        sph_##name##512_close(&ctx, out);                                \
+    }
+
+QUARK_SPH_HASH(blake)
+QUARK_SPH_HASH(bmw)
+QUARK_SPH_HASH(groestl)
+QUARK_SPH_HASH(jh)
+QUARK_SPH_HASH(keccak)
+QUARK_SPH_HASH(skein)
+
+#undef QUARK_SPH_HASH
+
+/** The steps with more than one implementation. */
+struct QuarkKernels {
+    const char* name;
+    Hash512_64 groestl;
+    Hash512_64 jh;
+};
+
+const QuarkKernels kernelsReference = {"sphlib", groestl512_64, jh512_64};
+#ifdef USE_QUARK_X86
+const QuarkKernels kernelsX86 = {"sse2+aesni", quark_x86::Groestl512_64, quark_x86::JH512_64};
+#endif
+
+const QuarkKernels& SelectKernels()
+{
+#ifdef USE_QUARK_X86
+    if (quark_x86::Supported())
+        return kernelsX86;
+#endif
+    return kernelsReference;
+}
+
+/** Picked once, on first use; block hashes are computed during static initialization. */
+const QuarkKernels& Kernels()
+{
+    static const QuarkKernels& kernels = SelectKernels();
+    return kernels;
+}
+
+/** Bit 3 of the previous 512-bit result, read as a little endian number, picks between two hashes. */
+inline bool Branch(const unsigned char* hash)
+{
+    return hash[0] & 8;
+}
+
+void Quark(const QuarkKernels& kernels, const unsigned char* data, size_t len, unsigned char out[QUARK_OUTPUT_SIZE])
+{
+    // Steps alternate between two buffers; the input is read in place, so a
+    // block header goes straight from its 80 serialized bytes into Blake.
+    unsigned char a[64], b[64];
+
+    sph_blake512_context ctx;
+    sph_blake512_init(&ctx);
+    sph_blake512(&ctx, data, len);
+    sph_blake512_close(&ctx, a);
+
+    bmw512_64(a, b);
+    if (Branch(b))
+        kernels.groestl(b, a);
+    else
+        skein512_64(b, a);
+    kernels.groestl(a, b);
+    kernels.jh(b, a);
+    if (Branch(a))
+        blake512_64(a, b);
+    else
+        bmw512_64(a, b);
+    keccak512_64(b, a);
+    skein512_64(a, b);
+    if (Branch(b))
+        keccak512_64(b, a);
+    else
+        kernels.jh(b, a);
+
+    memcpy(out, a, QUARK_OUTPUT_SIZE);
+}
+} // namespace
+
+void QuarkHash(const unsigned char* data, size_t len, unsigned char out[QUARK_OUTPUT_SIZE])
+{
+    Quark(Kernels(), data, len, out);
+}
+
+void QuarkHashReference(const unsigned char* data, size_t len, unsigned char out[QUARK_OUTPUT_SIZE])
+{
+    Quark(kernelsReference, data, len, out);
+}
+
+const char* QuarkHashImplementation()
+{
+    return Kernels().name;
+}
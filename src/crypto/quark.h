@@ -0,0 +1,25 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_QUARK_H
+#define BITCOIN_CRYPTO_QUARK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static const size_t QUARK_OUTPUT_SIZE = 32;
+
+/**
+ * Quark: the chain of nine 512-bit hashes used for block and spork hashes,
+ * truncated to 256 bits. Uses the fastest kernels the CPU supports.
+ */
+void QuarkHash(const unsigned char* data, size_t len, unsigned char out[QUARK_OUTPUT_SIZE]);
+
+/** Quark on the portable sphlib code only, to check and measure QuarkHash against. */
+void QuarkHashReference(const unsigned char* data, size_t len, unsigned char out[QUARK_OUTPUT_SIZE]);
+
+/** Name of the kernels QuarkHash picked at startup. */
+const char* QuarkHashImplementation();
+
+#endif // BITCOIN_CRYPTO_QUARK_H
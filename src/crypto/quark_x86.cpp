@@ -0,0 +1,370 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Vectorized Groestl-512 and JH-512 for the Quark chain. Both only ever see
+// single 64-byte inputs there, so the padding block is folded into the code.
+// The functions carry their own target attributes so that the rest of the
+// binary keeps building for the baseline instruction set; quark.cpp only calls
+// them after checking CPUID.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <cpuid.h>
+#include <immintrin.h>
+#include <stdint.h>
+#include <string.h>
+
+#define QUARK_TARGET_AES __attribute__((target("sse2,ssse3,aes")))
+#define QUARK_TARGET_SSE2 __attribute__((target("sse2")))
+#define QUARK_INLINE inline __attribute__((always_inline))
+
+namespace quark_x86
+{
+namespace groestl
+{
+// Rows of the 8x16 Groestl-512 state are kept in one register each; lane j is column j.
+
+/** pshufb masks undoing AESENCLAST's ShiftRows and applying Groestl's ShiftBytes for one row. */
+static const unsigned char SHIFT_P[8][16] __attribute__((aligned(16))) = {
+    {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3},
+    {13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0},
+    {10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13},
+    {7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10},
+    {4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7},
+    {1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4},
+    {14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1},
+    {15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2},
+};
+static const unsigned char SHIFT_Q[8][16] __attribute__((aligned(16))) = {
+    {13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0},
+    {7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10},
+    {1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4},
+    {15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2},
+    {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3},
+    {10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13},
+    {4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7},
+    {14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1},
+};
+
+static QUARK_INLINE QUARK_TARGET_AES __m128i XTime(__m128i x)
+{
+    __m128i carry = _mm_and_si128(_mm_cmplt_epi8(x, _mm_setzero_si128()), _mm_set1_epi8(0x1b));
+    return _mm_xor_si128(_mm_add_epi8(x, x), carry);
+}
+
+/** MixBytes with the circulant (02 02 03 04 05 03 05 07). */
+static QUARK_INLINE QUARK_TARGET_AES void MixBytes(__m128i& a0, __m128i& a1, __m128i& a2, __m128i& a3, __m128i& a4, __m128i& a5, __m128i& a6, __m128i& a7)
+{
+    // Row i of the result is 2(r0 + r1 + r2 + r5 + r7) + 4(r3 + r4 + r6 + r7) + (r2 + r4 + r5 + r6 + r7),
+    // with rk = a[(i + k) % 8]; the sums of adjacent rows are shared between outputs.
+    const __m128i x01 = _mm_xor_si128(a0, a1), x12 = _mm_xor_si128(a1, a2), x23 = _mm_xor_si128(a2, a3), x34 = _mm_xor_si128(a3, a4);
+    const __m128i x45 = _mm_xor_si128(a4, a5), x56 = _mm_xor_si128(a5, a6), x67 = _mm_xor_si128(a6, a7), x70 = _mm_xor_si128(a7, a0);
+
+#define GROESTL_MIX(o, r2, r5, r7, s01, s34, s45, s67)                                           \
+    __m128i o;                                                                                  \
+    {                                                                                           \
+        const __m128i two = _mm_xor_si128(_mm_xor_si128(s01, r2), _mm_xor_si128(r5, r7));       \
+        const __m128i four = _mm_xor_si128(s34, s67);                                           \
+        const __m128i one = _mm_xor_si128(r2, _mm_xor_si128(s45, s67));                         \
+        o = _mm_xor_si128(XTime(_mm_xor_si128(two, XTime(four))), one);                         \
+    }
+
+    GROESTL_MIX(y0, a2, a5, a7, x01, x34, x45, x67)
+    GROESTL_MIX(y1, a3, a6, a0, x12, x45, x56, x70)
+    GROESTL_MIX(y2, a4, a7, a1, x23, x56, x67, x01)
+    GROESTL_MIX(y3, a5, a0, a2, x34, x67, x70, x12)
+    GROESTL_MIX(y4, a6, a1, a3, x45, x70, x01, x23)
+    GROESTL_MIX(y5, a7, a2, a4, x56, x01, x12, x34)
+    GROESTL_MIX(y6, a0, a3, a5, x67, x12, x23, x45)
+    GROESTL_MIX(y7, a1, a4, a6, x70, x23, x34, x56)
+#undef GROESTL_MIX
+
+    a0 = y0;
+    a1 = y1;
+    a2 = y2;
+    a3 = y3;
+    a4 = y4;
+    a5 = y5;
+    a6 = y6;
+    a7 = y7;
+}
+
+/** SubBytes and ShiftBytes: AESENCLAST with a zero key is SubBytes after AES ShiftRows, which the shuffle undoes. */
+static QUARK_INLINE QUARK_TARGET_AES __m128i SubShift(__m128i x, const unsigned char* shift)
+{
+    return _mm_shuffle_epi8(_mm_aesenclast_si128(x, _mm_setzero_si128()), _mm_load_si128((const __m128i*)shift));
+}
+
+/** One round of P1024 (fQ = false) or Q1024 (fQ = true) on rows a0..a7. */
+#define GROESTL_ROUND(fQ, r)                                                                  \
+    do {                                                                                     \
+        const __m128i rc = _mm_xor_si128(columns, _mm_set1_epi8((char)(r)));                 \
+        if (fQ) {                                                                            \
+            a0 = _mm_xor_si128(a0, ones);                                                    \
+            a1 = _mm_xor_si128(a1, ones);                                                    \
+            a2 = _mm_xor_si128(a2, ones);                                                    \
+            a3 = _mm_xor_si128(a3, ones);                                                    \
+            a4 = _mm_xor_si128(a4, ones);                                                    \
+            a5 = _mm_xor_si128(a5, ones);                                                    \
+            a6 = _mm_xor_si128(a6, ones);                                                    \
+            a7 = _mm_xor_si128(a7, rc);                                                      \
+        } else {                                                                             \
+            a0 = _mm_xor_si128(a0, rc);                                                      \
+        }                                                                                    \
+        const unsigned char(*shift)[16] = fQ ? SHIFT_Q : SHIFT_P;                            \
+        a0 = SubShift(a0, shift[0]);                                                         \
+        a1 = SubShift(a1, shift[1]);                                                         \
+        a2 = SubShift(a2, shift[2]);                                                         \
+        a3 = SubShift(a3, shift[3]);                                                         \
+        a4 = SubShift(a4, shift[4]);                                                         \
+        a5 = SubShift(a5, shift[5]);                                                         \
+        a6 = SubShift(a6, shift[6]);                                                         \
+        a7 = SubShift(a7, shift[7]);                                                         \
+        MixBytes(a0, a1, a2, a3, a4, a5, a6, a7);                                            \
+    } while (0)
+
+/** Groestl's P1024 (fQ = false) or Q1024 (fQ = true) permutation. */
+template <bool fQ>
+static QUARK_TARGET_AES void Permute(__m128i* a)
+{
+    // Round constants: the column number in the high nibble of row 0 for P, and of
+    // the complemented row 7 for Q, plus the round number.
+    const __m128i ones = _mm_set1_epi8((char)0xff);
+    const __m128i columns = fQ ? _mm_set_epi8(0x0f, 0x1f, 0x2f, 0x3f, 0x4f, 0x5f, 0x6f, 0x7f, 0x8f, 0x9f, 0xaf, 0xbf, 0xcf, 0xdf, 0xef, 0xff) :
+                                 _mm_set_epi8(0xf0, 0xe0, 0xd0, 0xc0, 0xb0, 0xa0, 0x90, 0x80, 0x70, 0x60, 0x50, 0x40, 0x30, 0x20, 0x10, 0x00);
+    __m128i a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3], a4 = a[4], a5 = a[5], a6 = a[6], a7 = a[7];
+    for (int r = 0; r < 14; r++)
+        GROESTL_ROUND(fQ, r);
+    a[0] = a0;
+    a[1] = a1;
+    a[2] = a2;
+    a[3] = a3;
+    a[4] = a4;
+    a[5] = a5;
+    a[6] = a6;
+    a[7] = a7;
+}
+
+#undef GROESTL_ROUND
+} // namespace groestl
+
+/** Groestl-512 of exactly 64 bytes, using AES-NI for SubBytes. */
+QUARK_TARGET_AES void Groestl512_64(const unsigned char* in, unsigned char* out)
+{
+    using namespace groestl;
+
+    // The single padded block: message, 0x80, zeros, and a block count of one.
+    unsigned char m[8][16] __attribute__((aligned(16)));
+    for (int c = 0; c < 8; c++)
+        for (int r = 0; r < 8; r++)
+            m[r][c] = in[c * 8 + r];
+    for (int r = 0; r < 8; r++)
+        memset(&m[r][8], 0, 8);
+    m[0][8] = 0x80;
+    m[7][15] = 0x01;
+
+    // The chaining value starts as the output length, 512, in its last bytes.
+    __m128i h[8], p[8], q[8];
+    for (int r = 0; r < 8; r++) {
+        h[r] = _mm_setzero_si128();
+        q[r] = _mm_load_si128((const __m128i*)m[r]);
+        p[r] = q[r];
+    }
+    h[6] = _mm_insert_epi16(h[6], 0x0200, 7);
+    p[6] = _mm_xor_si128(p[6], h[6]);
+
+    Permute<false>(p);
+    Permute<true>(q);
+    for (int r = 0; r < 8; r++)
+        h[r] = _mm_xor_si128(h[r], _mm_xor_si128(p[r], q[r]));
+
+    // Output transformation: the right half of P(h) ^ h.
+    for (int r = 0; r < 8; r++)
+        p[r] = h[r];
+    Permute<false>(p);
+    for (int r = 0; r < 8; r++)
+        _mm_store_si128((__m128i*)m[r], _mm_xor_si128(p[r], h[r]));
+    for (int c = 0; c < 8; c++)
+        for (int r = 0; r < 8; r++)
+            out[c * 8 + r] = m[r][c + 8];
+}
+
+namespace jh
+{
+// sphlib's 64-bit bitsliced JH, with each (high, low) word pair in one register.
+// Words are loaded little endian; every step is either bitwise or symmetric in
+// byte order, so only the constants need byte swapping.
+
+/** Round constants, two registers per round (even words, odd words). */
+static const uint64_t C[168] __attribute__((aligned(16))) = {
+    0x67f815dfa2ded572ULL, 0x571523b70a15847bULL, 0xf6875a4d90d6ab81ULL, 0x402bd1c3c54f9f4eULL,
+    0x9cfa455ce03a98eaULL, 0x9a99b26699d2c503ULL, 0x8a53bbf2b4960266ULL, 0x31a2db881a1456b5ULL,
+    0xdb0e199a5c5aa303ULL, 0x1044c1870ab23f40ULL, 0x1d959e848019051cULL, 0xdccde75eadeb336fULL,
+    0x416bbf029213ba10ULL, 0xd027bbf7156578dcULL, 0x5078aa3739812c0aULL, 0xd3910041d2bf1a3fULL,
+    0x907eccf60d5a2d42ULL, 0xce97c0929c9f62ddULL, 0xac442bc70ba75c18ULL, 0x23fcc663d665dfd1ULL,
+    0x1ab8e09e036c6e97ULL, 0xa8ec6c447e450521ULL, 0xfa618e5dbb03f1eeULL, 0x97818394b29796fdULL,
+    0x2f3003db37858e4aULL, 0x956a9ffb2d8d672aULL, 0x6c69b8f88173fe8aULL, 0x14427fc04672c78aULL,
+    0xc45ec7bd8f15f4c5ULL, 0x80bb118fa76f4475ULL, 0xbc88e4aeb775de52ULL, 0xf4a3a6981e00b882ULL,
+    0x1563a3a9338ff48eULL, 0x89f9b7d524565faaULL, 0xfde05a7c20edf1b6ULL, 0x362c42065ae9ca36ULL,
+    0x3d98fe4e433529ceULL, 0xa74b9a7374f93a53ULL, 0x86814e6f591ff5d0ULL, 0x9f5ad8af81ad9d0eULL,
+    0x6a6234ee670605a7ULL, 0x2717b96ebe280b8bULL, 0x3f1080c626077447ULL, 0x7b487ec66f7ea0e0ULL,
+    0xc0a4f84aa50a550dULL, 0x9ef18e979fe7e391ULL, 0xd48d605081727686ULL, 0x62b0e5f3415a9e7eULL,
+    0x7a205440ec1f9ffcULL, 0x84c9f4ce001ae4e3ULL, 0xd895fa9df594d74fULL, 0xa554c324117e2e55ULL,
+    0x286efebd2872df5bULL, 0xb2c4a50fe27ff578ULL, 0x2ed349eeef7c8905ULL, 0x7f5928eb85937e44ULL,
+    0x4a3124b337695f70ULL, 0x65e4d61df128865eULL, 0xe720b95104771bc7ULL, 0x8a87d423e843fe74ULL,
+    0xf2947692a3e8297dULL, 0xc1d9309b097acbddULL, 0xe01bdc5bfb301b1dULL, 0xbf829cf24f4924daULL,
+    0xffbf70b431bae7a4ULL, 0x48bcf8de0544320dULL, 0x39d3bb5332fcae3bULL, 0xa08b29e0c1c39f45ULL,
+    0x0f09aef7fd05c9e5ULL, 0x34f1904212347094ULL, 0x95ed44e301b771a2ULL, 0x4a982f4f368e3be9ULL,
+    0x15f66ca0631d4088ULL, 0xffaf52874b44c147ULL, 0x30c60ae2f14abb7eULL, 0xe68c6eccc5b67046ULL,
+    0x00ca4fbd56a4d5a4ULL, 0xae183ec84b849ddaULL, 0xadd1643045ce5773ULL, 0x67255c1468cea6e8ULL,
+    0x16e10ecbf28cdaa3ULL, 0x9a99949a5806e933ULL, 0x7b846fc220b2601fULL, 0x1885d1a07facced1ULL,
+    0xd319dd8da15b5932ULL, 0x46b4a5aac01c9a50ULL, 0xba6b04e467633d9fULL, 0x7eee560bab19caf6ULL,
+    0x742128a9ea79b11fULL, 0xee51363b35f7bde9ULL, 0x76d350755aac571dULL, 0x01707da3fec2463aULL,
+    0x42d8a498afc135f7ULL, 0x79676b9e20eced78ULL, 0xa8db3aea15638341ULL, 0x832c83324d3bc3faULL,
+    0xf347271c1f3b40a7ULL, 0x9a762db734f04059ULL, 0xfd4f21d26c4e3ee7ULL, 0xef5957dc398dfdb8ULL,
+    0xdaeb492b490c9b8dULL, 0x0d70f36849d7a25bULL, 0x84558d7ad0ae3b7dULL, 0x658ef8e4f0e9a5f5ULL,
+    0x533b1036f4a2b8a0ULL, 0x5aec3e759e07a80cULL, 0x4f88e85692946891ULL, 0x4cbcbaf8555cb05bULL,
+    0x7b9487f3993bbbe3ULL, 0x5d1c6b72d6f4da75ULL, 0x6db334dc28acae64ULL, 0x71db28b850a5346cULL,
+    0x2a518d10f2e261f8ULL, 0xfc75dd593364dbe3ULL, 0xa23fce43f1bcac1cULL, 0xb043e8023cd1bb67ULL,
+    0x75a12988ca5b0a33ULL, 0x5c5316b44d19347fULL, 0x1e4d790ec3943b92ULL, 0x3fafeeb6d7757479ULL,
+    0x21391abef7d4a8eaULL, 0x5127234c097ef45cULL, 0xd23c32ba5324a326ULL, 0xadd5a66d4a17a344ULL,
+    0x08c9f2afa63e1db5ULL, 0x563c6b91983d5983ULL, 0x4d608672a17cf84cULL, 0xf6c76e08cc3ee246ULL,
+    0x5e76bcb1b333982fULL, 0x2ae6c4efa566d62bULL, 0x36d4c1bee8b6f406ULL, 0x6321efbc1582ee74ULL,
+    0x69c953f40d4ec1fdULL, 0x26585806c45a7da7ULL, 0x16fae0061614c17eULL, 0x3f9d63283daf907eULL,
+    0x0cd29b00e3f2c9d2ULL, 0x300cd4b730ceaa5fULL, 0x9832e0f216512a74ULL, 0x9af8cee3d830eb0dULL,
+    0x9279f1b57b9ec54bULL, 0xd36886046ee651ffULL, 0x316796e6574d239bULL, 0x05750a17f3a6e6ccULL,
+    0xce6c3213d98176b1ULL, 0x62a205f88452173cULL, 0x47154778b3cb2bf4ULL, 0x486a9323825446ffULL,
+    0x65655e4e0758df38ULL, 0x8e5086fc897cfcf2ULL, 0x86ca0bd0442e7031ULL, 0x4e477830a20940f0ULL,
+    0x8338f7d139eea065ULL, 0xbd3a2ce437e95ef7ULL, 0x6ff8130126b29721ULL, 0xe7de9fefd1ed44a3ULL,
+    0xd992257615dfa08bULL, 0xbe42dc12f6f7853cULL, 0x7eb027ab7ceca7d8ULL, 0xdea83eaada7d8d53ULL,
+    0xd86902bd93ce25aaULL, 0xf908731afd43f65aULL, 0xa5194a17daef5fc0ULL, 0x6a21fd4c33664d97ULL,
+    0x701541db3198b435ULL, 0x9b54cdedbb0f1eeaULL, 0x72409751a163d09aULL, 0xe26f4791bf9d75f6ULL,
+};
+
+static const uint64_t IV512[16] __attribute__((aligned(16))) = {
+    0x17aa003e964bd16fULL, 0x43d5157a052e6a63ULL, 0x0bef970c8d5e228aULL, 0x61c3b3f2591234e9ULL,
+    0x1e806f53c1a01d89ULL, 0x806d2bea6b05a92aULL, 0xa6ba7520dbcc8e58ULL, 0xf73bf8ba763a0fa9ULL,
+    0x694ae34105e66901ULL, 0x5ae66f2e8e8ab546ULL, 0x243c84c1d0a74710ULL, 0x99c15a2db1716e3bULL,
+    0x56f8b19decf657cfULL, 0x56b116577c8806a7ULL, 0xfb1785e6dffcc2e3ULL, 0x4bdd8ccc78465a54ULL,
+};
+
+#define JH_ANDNOT(a, b) _mm_andnot_si128(a, b) /* ~a & b */
+
+static QUARK_INLINE QUARK_TARGET_SSE2 void Sb(__m128i& x0, __m128i& x1, __m128i& x2, __m128i& x3, __m128i c)
+{
+    const __m128i ones = _mm_set1_epi32(-1);
+    x3 = _mm_xor_si128(x3, ones);
+    x0 = _mm_xor_si128(x0, JH_ANDNOT(x2, c));
+    __m128i tmp = _mm_xor_si128(c, _mm_and_si128(x0, x1));
+    x0 = _mm_xor_si128(x0, _mm_and_si128(x2, x3));
+    x3 = _mm_xor_si128(x3, JH_ANDNOT(x1, x2));
+    x1 = _mm_xor_si128(x1, _mm_and_si128(x0, x2));
+    x2 = _mm_xor_si128(x2, JH_ANDNOT(x3, x0));
+    x0 = _mm_xor_si128(x0, _mm_or_si128(x1, x3));
+    x3 = _mm_xor_si128(x3, _mm_and_si128(x1, x2));
+    x1 = _mm_xor_si128(x1, _mm_and_si128(tmp, x0));
+    x2 = _mm_xor_si128(x2, tmp);
+}
+
+static QUARK_INLINE QUARK_TARGET_SSE2 void Lb(__m128i& x0, __m128i& x1, __m128i& x2, __m128i& x3, __m128i& x4, __m128i& x5, __m128i& x6, __m128i& x7)
+{
+    x4 = _mm_xor_si128(x4, x1);
+    x5 = _mm_xor_si128(x5, x2);
+    x6 = _mm_xor_si128(x6, _mm_xor_si128(x3, x0));
+    x7 = _mm_xor_si128(x7, x0);
+    x0 = _mm_xor_si128(x0, x5);
+    x1 = _mm_xor_si128(x1, x6);
+    x2 = _mm_xor_si128(x2, _mm_xor_si128(x7, x4));
+    x3 = _mm_xor_si128(x3, x4);
+}
+
+#define JH_SWAP_BITS(x, mask, n) _mm_or_si128(_mm_and_si128(_mm_srli_epi64(x, n), mask), _mm_slli_epi64(_mm_and_si128(x, mask), n))
+
+/** The permutation Wr applied to the odd words. */
+template <int r>
+static QUARK_INLINE QUARK_TARGET_SSE2 __m128i W(__m128i x)
+{
+    switch (r) {
+    case 0: return JH_SWAP_BITS(x, _mm_set1_epi8(0x55), 1);
+    case 1: return JH_SWAP_BITS(x, _mm_set1_epi8(0x33), 2);
+    case 2: return JH_SWAP_BITS(x, _mm_set1_epi8(0x0f), 4);
+    case 3: return JH_SWAP_BITS(x, _mm_set1_epi16(0x00ff), 8);
+    case 4: return JH_SWAP_BITS(x, _mm_set1_epi32(0x0000ffff), 16);
+    case 5: return _mm_shuffle_epi32(x, 0xb1);
+    default: return _mm_shuffle_epi32(x, 0x4e);
+    }
+}
+
+template <int ro>
+static QUARK_INLINE QUARK_TARGET_SSE2 void SL(__m128i* h, int r)
+{
+    Sb(h[0], h[2], h[4], h[6], _mm_load_si128((const __m128i*)&C[(r << 2) + 0]));
+    Sb(h[1], h[3], h[5], h[7], _mm_load_si128((const __m128i*)&C[(r << 2) + 2]));
+    Lb(h[0], h[2], h[4], h[6], h[1], h[3], h[5], h[7]);
+    h[1] = W<ro>(h[1]);
+    h[3] = W<ro>(h[3]);
+    h[5] = W<ro>(h[5]);
+    h[7] = W<ro>(h[7]);
+}
+
+static QUARK_TARGET_SSE2 void E8(__m128i* h)
+{
+    for (int r = 0; r < 42; r += 7) {
+        SL<0>(h, r + 0);
+        SL<1>(h, r + 1);
+        SL<2>(h, r + 2);
+        SL<3>(h, r + 3);
+        SL<4>(h, r + 4);
+        SL<5>(h, r + 5);
+        SL<6>(h, r + 6);
+    }
+}
+
+#undef JH_SWAP_BITS
+#undef JH_ANDNOT
+
+static QUARK_INLINE QUARK_TARGET_SSE2 void Compress(__m128i* h, const __m128i* m)
+{
+    for (int i = 0; i < 4; i++)
+        h[i] = _mm_xor_si128(h[i], m[i]);
+    E8(h);
+    for (int i = 0; i < 4; i++)
+        h[i + 4] = _mm_xor_si128(h[i + 4], m[i]);
+}
+} // namespace jh
+
+/** JH-512 of exactly 64 bytes with SSE2. */
+QUARK_TARGET_SSE2 void JH512_64(const unsigned char* in, unsigned char* out)
+{
+    using namespace jh;
+
+    __m128i h[8], m[4];
+    for (int i = 0; i < 8; i++)
+        h[i] = _mm_load_si128((const __m128i*)&IV512[i * 2]);
+    for (int i = 0; i < 4; i++)
+        m[i] = _mm_loadu_si128((const __m128i*)(in + i * 16));
+    Compress(h, m);
+
+    // Padding block: 0x80, then the message length in bits as a 128-bit big endian number.
+    m[0] = _mm_set_epi32(0, 0, 0, 0x80);
+    m[1] = _mm_setzero_si128();
+    m[2] = _mm_setzero_si128();
+    m[3] = _mm_set_epi32(0x00020000, 0, 0, 0);
+    Compress(h, m);
+
+    for (int i = 0; i < 4; i++)
+        _mm_storeu_si128((__m128i*)(out + i * 16), h[i + 4]);
+}
+
+/** Whether the CPU runs Groestl512_64; JH512_64 only needs SSE2, which every x86-64 has. */
+bool Supported()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (edx & (1 << 26)) && (ecx & (1 << 9)) && (ecx & (1 << 25)); // SSE2, SSSE3, AES-NI
+}
+} // namespace quark_x86
+
+#endif
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,30 @@ public:
     CSHA256& Reset();
 };
 
+namespace sha256_implementation
+{
+/** Backends SHA256AutoDetect may pick; the portable code is always available. */
+enum UseImplementation {
+    STANDARD = 0,
+    USE_SSE4 = 1 << 0,
+    USE_AVX2 = 1 << 1,
+    USE_SHANI = 1 << 2,
+    USE_ALL = USE_SSE4 | USE_AVX2 | USE_SHANI
+};
+}
+
+/**
+ * Select the fastest SHA-256 code the CPU supports, limited to the backends in use,
+ * and return a description of it. Not thread safe: call at startup, before hashing
+ * from more than one thread.
+ */
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation use = sha256_implementation::USE_ALL);
+
+/**
+ * Compute the double SHA-256 of each of `blocks` consecutive 64-byte inputs, such as
+ * pairs of merkle tree nodes, into `blocks` consecutive 32-byte outputs. Several
+ * inputs are hashed in parallel where the CPU allows.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,219 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 with the x86 SHA extensions, after Intel's reference code. The state
+// is kept as the (ABEF, CDGH) register pair SHA256RNDS2 works on. Only called
+// after sha256.cpp checked CPUID.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_TARGET __attribute__((target("sse4.1,sha")))
+#define SHA256_INLINE inline __attribute__((always_inline))
+
+namespace sha256_shani
+{
+namespace
+{
+/** Round constants, four per register. */
+static const uint32_t K[64] __attribute__((aligned(16))) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Round constants plus the message schedule of the padding block that follows a 64-byte input. */
+static const uint32_t KPAD64[64] __attribute__((aligned(16))) = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76,
+};
+
+SHA256_INLINE SHA256_TARGET __m128i LoadK(const uint32_t* k, int i)
+{
+    return _mm_load_si128((const __m128i*)(k + 4 * i));
+}
+
+/** Four rounds with constant-plus-schedule words kw. */
+SHA256_INLINE SHA256_TARGET void QuadRound(__m128i& state0, __m128i& state1, __m128i kw)
+{
+    state1 = _mm_sha256rnds2_epu32(state1, state0, kw);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(kw, 0x0e));
+}
+
+/** Rounds 4i..4i+3 of a message block, advancing the schedule held in m[0..3]. */
+SHA256_INLINE SHA256_TARGET void QuadRoundMessage(__m128i& state0, __m128i& state1, __m128i* m, int i)
+{
+    __m128i& cur = m[i & 3];
+    QuadRound(state0, state1, _mm_add_epi32(cur, LoadK(K, i)));
+    if (i >= 3 && i < 15) {
+        __m128i& next = m[(i + 1) & 3];
+        next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(cur, m[(i - 1) & 3], 4)), cur);
+    }
+    if (i >= 1 && i < 13) {
+        __m128i& prev = m[(i - 1) & 3];
+        prev = _mm_sha256msg1_epu32(prev, cur);
+    }
+}
+
+/** Compress one block, given as four registers of big endian words, into (state0, state1). */
+SHA256_INLINE SHA256_TARGET void Compress(__m128i& state0, __m128i& state1, __m128i* m)
+{
+    const __m128i abef = state0, cdgh = state1;
+    for (int i = 0; i < 16; i++)
+        QuadRoundMessage(state0, state1, m, i);
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+}
+
+/** Compress two independent blocks; interleaving the rounds hides SHA256RNDS2's latency. */
+SHA256_INLINE SHA256_TARGET void Compress2(__m128i& state0a, __m128i& state1a, __m128i* ma, __m128i& state0b, __m128i& state1b, __m128i* mb)
+{
+    const __m128i abefa = state0a, cdgha = state1a, abefb = state0b, cdghb = state1b;
+    for (int i = 0; i < 16; i++) {
+        QuadRoundMessage(state0a, state1a, ma, i);
+        QuadRoundMessage(state0b, state1b, mb, i);
+    }
+    state0a = _mm_add_epi32(state0a, abefa);
+    state1a = _mm_add_epi32(state1a, cdgha);
+    state0b = _mm_add_epi32(state0b, abefb);
+    state1b = _mm_add_epi32(state1b, cdghb);
+}
+
+/** Byte order mask turning four big endian words into native ones. */
+SHA256_INLINE SHA256_TARGET __m128i BSwapMask()
+{
+    return _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+}
+
+SHA256_INLINE SHA256_TARGET void LoadBlock(__m128i* m, const unsigned char* chunk)
+{
+    const __m128i mask = BSwapMask();
+    for (int i = 0; i < 4; i++)
+        m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16 * i)), mask);
+}
+
+/** Convert state words a..h to the (ABEF, CDGH) pair. */
+SHA256_INLINE SHA256_TARGET void Unpack(__m128i& state0, __m128i& state1, __m128i dcba, __m128i hgfe)
+{
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    state0 = _mm_alignr_epi8(cdab, efgh, 8);
+    state1 = _mm_blend_epi16(efgh, cdab, 0xf0);
+}
+
+/** Convert the (ABEF, CDGH) pair back to state words a..h. */
+SHA256_INLINE SHA256_TARGET void Pack(__m128i& dcba, __m128i& hgfe, __m128i state0, __m128i state1)
+{
+    __m128i feba = _mm_shuffle_epi32(state0, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(state1, 0xb1);
+    dcba = _mm_blend_epi16(feba, dchg, 0xf0);
+    hgfe = _mm_alignr_epi8(dchg, feba, 8);
+}
+
+SHA256_INLINE SHA256_TARGET void Initialize(__m128i& state0, __m128i& state1)
+{
+    Unpack(state0, state1, _mm_set_epi32(0xa54ff53a, 0x3c6ef372, 0xbb67ae85, 0x6a09e667), _mm_set_epi32(0x5be0cd19, 0x1f83d9ab, 0x9b05688c, 0x510e527f));
+}
+
+/** The block holding a 32-byte digest and its padding, for the second hash of SHA256D. */
+SHA256_INLINE SHA256_TARGET void PadDigest(__m128i* m, __m128i state0, __m128i state1)
+{
+    Pack(m[0], m[1], state0, state1);
+    m[2] = _mm_set_epi32(0, 0, 0, 0x80000000);
+    m[3] = _mm_set_epi32(256, 0, 0, 0);
+}
+
+SHA256_INLINE SHA256_TARGET void StoreDigest(unsigned char* out, __m128i state0, __m128i state1)
+{
+    __m128i dcba, hgfe;
+    Pack(dcba, hgfe, state0, state1);
+    const __m128i mask = BSwapMask();
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(dcba, mask));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_shuffle_epi8(hgfe, mask));
+}
+} // namespace
+
+SHA256_TARGET void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i state0, state1, m[4];
+    Unpack(state0, state1, _mm_loadu_si128((const __m128i*)s), _mm_loadu_si128((const __m128i*)(s + 4)));
+    while (blocks--) {
+        LoadBlock(m, chunk);
+        Compress(state0, state1, m);
+        chunk += 64;
+    }
+    __m128i dcba, hgfe;
+    Pack(dcba, hgfe, state0, state1);
+    _mm_storeu_si128((__m128i*)s, dcba);
+    _mm_storeu_si128((__m128i*)(s + 4), hgfe);
+}
+
+SHA256_TARGET void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    __m128i state0, state1, m[4];
+
+    // First hash: the input block, then its padding block, whose schedule is constant.
+    Initialize(state0, state1);
+    LoadBlock(m, in);
+    Compress(state0, state1, m);
+    const __m128i abef = state0, cdgh = state1;
+    for (int i = 0; i < 16; i++)
+        QuadRound(state0, state1, LoadK(KPAD64, i));
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+
+    // Second hash: the 32-byte digest, padded to one block.
+    PadDigest(m, state0, state1);
+    Initialize(state0, state1);
+    Compress(state0, state1, m);
+
+    StoreDigest(out, state0, state1);
+}
+
+SHA256_TARGET void TransformD64_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i state0a, state1a, state0b, state1b, ma[4], mb[4];
+
+    Initialize(state0a, state1a);
+    Initialize(state0b, state1b);
+    LoadBlock(ma, in);
+    LoadBlock(mb, in + 64);
+    Compress2(state0a, state1a, ma, state0b, state1b, mb);
+    const __m128i abefa = state0a, cdgha = state1a, abefb = state0b, cdghb = state1b;
+    for (int i = 0; i < 16; i++) {
+        const __m128i kw = LoadK(KPAD64, i);
+        QuadRound(state0a, state1a, kw);
+        QuadRound(state0b, state1b, kw);
+    }
+    state0a = _mm_add_epi32(state0a, abefa);
+    state1a = _mm_add_epi32(state1a, cdgha);
+    state0b = _mm_add_epi32(state0b, abefb);
+    state1b = _mm_add_epi32(state1b, cdghb);
+
+    PadDigest(ma, state0a, state1a);
+    PadDigest(mb, state0b, state1b);
+    Initialize(state0a, state1a);
+    Initialize(state0b, state1b);
+    Compress2(state0a, state1a, ma, state0b, state1b, mb);
+
+    StoreDigest(out, state0a, state1a);
+    StoreDigest(out + 32, state0b, state1b);
+}
+} // namespace sha256_shani
+
+#endif
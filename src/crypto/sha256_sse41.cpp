@@ -0,0 +1,191 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way double SHA-256 of 64-byte inputs with SSE4.1: input i is hashed in
+// 32-bit lane i of every register. Only called after sha256.cpp checked CPUID.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include "crypto/common.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#define SHA256_TARGET __attribute__((target("sse4.1")))
+#define SHA256_INLINE inline __attribute__((always_inline))
+
+namespace sha256d64_sse41
+{
+namespace
+{
+typedef __m128i Vec;
+static const int LANES = 4;
+
+/** Round constants. */
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Round constants plus the message schedule of the padding block that follows a 64-byte input. */
+static const uint32_t KPAD64[64] = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76,
+};
+
+SHA256_INLINE SHA256_TARGET Vec Set(uint32_t x) { return _mm_set1_epi32(x); }
+SHA256_INLINE SHA256_TARGET Vec Add(Vec x, Vec y) { return _mm_add_epi32(x, y); }
+SHA256_INLINE SHA256_TARGET Vec Add(Vec x, Vec y, Vec z) { return Add(Add(x, y), z); }
+SHA256_INLINE SHA256_TARGET Vec Add(Vec x, Vec y, Vec z, Vec w) { return Add(Add(x, y), Add(z, w)); }
+SHA256_INLINE SHA256_TARGET Vec Xor(Vec x, Vec y) { return _mm_xor_si128(x, y); }
+SHA256_INLINE SHA256_TARGET Vec Xor(Vec x, Vec y, Vec z) { return Xor(Xor(x, y), z); }
+SHA256_INLINE SHA256_TARGET Vec Or(Vec x, Vec y) { return _mm_or_si128(x, y); }
+SHA256_INLINE SHA256_TARGET Vec And(Vec x, Vec y) { return _mm_and_si128(x, y); }
+SHA256_INLINE SHA256_TARGET Vec ShR(Vec x, int n) { return _mm_srli_epi32(x, n); }
+SHA256_INLINE SHA256_TARGET Vec ShL(Vec x, int n) { return _mm_slli_epi32(x, n); }
+SHA256_INLINE SHA256_TARGET Vec RotR(Vec x, int n) { return Or(ShR(x, n), ShL(x, 32 - n)); }
+
+SHA256_INLINE SHA256_TARGET Vec Ch(Vec x, Vec y, Vec z) { return Xor(z, And(x, Xor(y, z))); }
+SHA256_INLINE SHA256_TARGET Vec Maj(Vec x, Vec y, Vec z) { return Or(And(x, y), And(z, Or(x, y))); }
+SHA256_INLINE SHA256_TARGET Vec Sigma0(Vec x) { return Xor(RotR(x, 2), RotR(x, 13), RotR(x, 22)); }
+SHA256_INLINE SHA256_TARGET Vec Sigma1(Vec x) { return Xor(RotR(x, 6), RotR(x, 11), RotR(x, 25)); }
+SHA256_INLINE SHA256_TARGET Vec sigma0(Vec x) { return Xor(RotR(x, 7), RotR(x, 18), ShR(x, 3)); }
+SHA256_INLINE SHA256_TARGET Vec sigma1(Vec x) { return Xor(RotR(x, 17), RotR(x, 19), ShR(x, 10)); }
+
+/** One round of SHA-256; k is the round constant plus the schedule word. */
+SHA256_INLINE SHA256_TARGET void Round(Vec a, Vec b, Vec c, Vec& d, Vec e, Vec f, Vec g, Vec& h, Vec k)
+{
+    Vec t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    Vec t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Schedule word i, computed in place in the 16-word window w. */
+SHA256_INLINE SHA256_TARGET Vec Schedule(Vec* w, int i)
+{
+    if (i >= 16)
+        w[i & 15] = Add(w[i & 15], sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+    return w[i & 15];
+}
+
+/** Eight rounds starting at round i; the caller supplies constant-plus-schedule words through KW. */
+#define SHA256_ROUNDS8(KW)                          \
+    do {                                            \
+        Round(a, b, c, d, e, f, g, h, KW(i + 0));   \
+        Round(h, a, b, c, d, e, f, g, KW(i + 1));   \
+        Round(g, h, a, b, c, d, e, f, KW(i + 2));   \
+        Round(f, g, h, a, b, c, d, e, KW(i + 3));   \
+        Round(e, f, g, h, a, b, c, d, KW(i + 4));   \
+        Round(d, e, f, g, h, a, b, c, KW(i + 5));   \
+        Round(c, d, e, f, g, h, a, b, KW(i + 6));   \
+        Round(b, c, d, e, f, g, h, a, KW(i + 7));   \
+    } while (0)
+
+#define SHA256_KW_MESSAGE(j) Add(Set(K[j]), Schedule(w, j))
+#define SHA256_KW_PAD64(j) Set(KPAD64[j])
+
+/** Compress the message block w (clobbered) into state s. */
+SHA256_TARGET void Transform(Vec* s, Vec* w)
+{
+    Vec a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i += 8)
+        SHA256_ROUNDS8(SHA256_KW_MESSAGE);
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** Compress the padding block of a 64-byte message, whose schedule is constant, into state s. */
+SHA256_TARGET void TransformPad64(Vec* s)
+{
+    Vec a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i += 8)
+        SHA256_ROUNDS8(SHA256_KW_PAD64);
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+#undef SHA256_KW_PAD64
+#undef SHA256_KW_MESSAGE
+#undef SHA256_ROUNDS8
+
+SHA256_INLINE SHA256_TARGET void Initialize(Vec* s)
+{
+    s[0] = Set(0x6a09e667ul);
+    s[1] = Set(0xbb67ae85ul);
+    s[2] = Set(0x3c6ef372ul);
+    s[3] = Set(0xa54ff53aul);
+    s[4] = Set(0x510e527ful);
+    s[5] = Set(0x9b05688cul);
+    s[6] = Set(0x1f83d9abul);
+    s[7] = Set(0x5be0cd19ul);
+}
+
+/** Word i of every lane's input. */
+SHA256_INLINE SHA256_TARGET Vec Read(const unsigned char* in, int i)
+{
+    return _mm_set_epi32(ReadBE32(in + 192 + 4 * i), ReadBE32(in + 128 + 4 * i), ReadBE32(in + 64 + 4 * i), ReadBE32(in + 4 * i));
+}
+
+/** Store word i of every lane's output. */
+SHA256_INLINE SHA256_TARGET void Write(unsigned char* out, int i, Vec v)
+{
+    uint32_t lanes[LANES];
+    _mm_storeu_si128((Vec*)lanes, v);
+    for (int j = 0; j < LANES; j++)
+        WriteBE32(out + 32 * j + 4 * i, lanes[j]);
+}
+} // namespace
+
+SHA256_TARGET void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    Vec s[8], w[16];
+
+    // First hash: the input block, then its constant padding block.
+    Initialize(s);
+    for (int i = 0; i < 16; i++)
+        w[i] = Read(in, i);
+    Transform(s, w);
+    TransformPad64(s);
+
+    // Second hash: the 32-byte digest, padded to one block.
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = Set(0x80000000ul);
+    for (int i = 9; i < 15; i++)
+        w[i] = Set(0);
+    w[15] = Set(256);
+    Initialize(s);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; i++)
+        Write(out, i, s[i]);
+}
+} // namespace sha256d64_sse41
+
+#endif
@@ -0,0 +1,164 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "random.h"
+
+#include <limits>
+#include <string.h>
+
+CCuckooCache::CCuckooCache() : nBucketMask(0), nInserts(0), nEvictions(0), nKickRand(0)
+{
+    for (int i = 0; i < COUNTER_STRIPES; i++) {
+        counters[i].nHits.store(0, std::memory_order_relaxed);
+        counters[i].nMisses.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t CCuckooCache::Setup(size_t nMaxBytes)
+{
+    LOCK(cs_insert);
+    size_t nBuckets = 0;
+    if (nMaxBytes >= sizeof(Bucket)) {
+        nBuckets = 1;
+        while (nBuckets <= nMaxBytes / sizeof(Bucket) / 2)
+            nBuckets *= 2;
+    }
+    // Value-initialized, so every slot starts out empty
+    std::vector<Bucket> vNew(nBuckets);
+    vBuckets.swap(vNew);
+    nBucketMask = nBuckets ? nBuckets - 1 : 0;
+
+    for (int i = 0; i < COUNTER_STRIPES; i++) {
+        counters[i].nHits.store(0, std::memory_order_relaxed);
+        counters[i].nMisses.store(0, std::memory_order_relaxed);
+    }
+    nInserts = 0;
+    nEvictions = 0;
+    nKickRand = (uint32_t)GetRand(std::numeric_limits<uint32_t>::max());
+    return nBuckets * 2;
+}
+
+void CCuckooCache::Split(const uint256& digest, uint64_t w[4])
+{
+    memcpy(w, digest.begin(), 32);
+    w[0] |= 1;
+}
+
+bool CCuckooCache::Match(const Slot& slot, const uint64_t w[4])
+{
+    return slot.w[0].load(std::memory_order_relaxed) == w[0] &&
+           slot.w[1].load(std::memory_order_relaxed) == w[1] &&
+           slot.w[2].load(std::memory_order_relaxed) == w[2] &&
+           slot.w[3].load(std::memory_order_relaxed) == w[3];
+}
+
+void CCuckooCache::Store(Slot& slot, const uint64_t w[4])
+{
+    // Empty the slot first, so that lookups never see the new words under the old first one
+    slot.w[0].store(0, std::memory_order_relaxed);
+    slot.w[1].store(w[1], std::memory_order_relaxed);
+    slot.w[2].store(w[2], std::memory_order_relaxed);
+    slot.w[3].store(w[3], std::memory_order_relaxed);
+    slot.w[0].store(w[0], std::memory_order_release);
+}
+
+void CCuckooCache::Load(const Slot& slot, uint64_t w[4])
+{
+    for (int i = 0; i < 4; i++)
+        w[i] = slot.w[i].load(std::memory_order_relaxed);
+}
+
+CCuckooCache::Slot* CCuckooCache::FindEmpty(Bucket& bucket)
+{
+    for (int i = 0; i < 2; i++) {
+        if (bucket.slot[i].w[0].load(std::memory_order_relaxed) == 0)
+            return &bucket.slot[i];
+    }
+    return NULL;
+}
+
+bool CCuckooCache::Contains(const uint256& digest, bool fErase)
+{
+    if (vBuckets.empty())
+        return false;
+
+    uint64_t w[4];
+    Split(digest, w);
+    Counters& stripe = counters[w[1] % COUNTER_STRIPES];
+    Bucket* buckets[2] = {&First(w), &Second(w)};
+    for (int b = 0; b < 2; b++) {
+        for (int i = 0; i < 2; i++) {
+            Slot& slot = buckets[b]->slot[i];
+            if (Match(slot, w)) {
+                // Racing with an insert may drop the entry that replaced this one; that only costs a miss later
+                if (fErase)
+                    slot.w[0].store(0, std::memory_order_relaxed);
+                stripe.nHits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    stripe.nMisses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void CCuckooCache::Insert(const uint256& digest)
+{
+    uint64_t w[4];
+    Split(digest, w);
+
+    LOCK(cs_insert);
+    if (vBuckets.empty())
+        return;
+    for (int i = 0; i < 2; i++) {
+        if (Match(First(w).slot[i], w) || Match(Second(w).slot[i], w))
+            return;
+    }
+    nInserts++;
+
+    for (int nKicks = 0;; nKicks++) {
+        Slot* slot = FindEmpty(First(w));
+        if (!slot)
+            slot = FindEmpty(Second(w));
+        if (slot) {
+            Store(*slot, w);
+            return;
+        }
+        if (nKicks == MAX_KICKS)
+            break;
+
+        // Both buckets are full: take over a random one of their slots and find
+        // a place for its occupant in the occupant's other bucket
+        nKickRand = nKickRand * 1103515245 + 12345;
+        uint32_t r = nKickRand >> 16;
+        Slot& victim = ((r & 1) ? Second(w) : First(w)).slot[(r >> 1) & 1];
+        uint64_t displaced[4];
+        Load(victim, displaced);
+        Store(victim, w);
+        memcpy(w, displaced, sizeof(displaced));
+        // Erased by a lookup in the meantime, so there is nothing left to place
+        if (w[0] == 0)
+            return;
+    }
+    nEvictions++;
+}
+
+CCuckooCacheStats CCuckooCache::GetStats() const
+{
+    CCuckooCacheStats stats;
+    stats.nBytes = vBuckets.size() * sizeof(Bucket);
+    stats.nCapacity = vBuckets.size() * 2;
+    stats.nHits = 0;
+    stats.nMisses = 0;
+    for (int i = 0; i < COUNTER_STRIPES; i++) {
+        stats.nHits += counters[i].nHits.load(std::memory_order_relaxed);
+        stats.nMisses += counters[i].nMisses.load(std::memory_order_relaxed);
+    }
+    LOCK(cs_insert);
+    stats.nInserts = nInserts;
+    stats.nEvictions = nEvictions;
+    return stats;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+/** Counters of a CCuckooCache since its last Setup() */
+struct CCuckooCacheStats {
+    size_t nBytes;
+    size_t nCapacity;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nInserts;
+    uint64_t nEvictions;
+};
+
+/**
+ * A fixed-size set of 256-bit digests, for remembering the outcome of expensive
+ * checks. The table is one array of 64-byte buckets holding two digests each, and
+ * every digest may live in either of two buckets chosen by its own bits (cuckoo
+ * hashing), so digests must be salted hashes that peers cannot aim at a bucket.
+ *
+ * Contains() takes no lock and may run in any number of threads, also while
+ * Insert() is running. Slots are read and written one atomic word at a time, so
+ * a lookup racing with a write may see a mix of the old and new words; that can
+ * only match a digest sharing 192 bits with one of the two, which salted hashes
+ * never do. Inserts are serialized by an internal lock. When both buckets of a
+ * digest are full, Insert() moves occupants to their other bucket, and
+ * after MAX_KICKS moves evicts the last one displaced.
+ */
+class CCuckooCache
+{
+public:
+    CCuckooCache();
+
+    /**
+     * Empty the cache and size it to the largest power of two number of buckets
+     * that fits in nMaxBytes. Must not run concurrently with any other method.
+     * Returns the number of digests the table can hold.
+     */
+    size_t Setup(size_t nMaxBytes);
+
+    /** Whether digest is in the cache. With fErase a hit is also removed. */
+    bool Contains(const uint256& digest, bool fErase);
+    void Insert(const uint256& digest);
+
+    CCuckooCacheStats GetStats() const;
+
+private:
+    //! Number of occupants moved before Insert() gives up and evicts one. A long
+    //! walk costs far less than the signature check that precedes an insert, and
+    //! keeps evictions away until the table is about 80% full.
+    static const int MAX_KICKS = 128;
+    //! Lookups update one of this many counters, picked by digest, to keep threads
+    //! from bouncing a single cache line between cores
+    static const int COUNTER_STRIPES = 16;
+
+    //! A stored digest; the first word has its low bit set, so that zero means empty
+    struct Slot {
+        std::atomic<uint64_t> w[4];
+    };
+    struct Bucket {
+        Slot slot[2];
+    };
+    struct Counters {
+        std::atomic<uint64_t> nHits;
+        std::atomic<uint64_t> nMisses;
+        char padding[64 - 2 * sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::vector<Bucket> vBuckets;
+    uint64_t nBucketMask;
+    Counters counters[COUNTER_STRIPES];
+
+    mutable CCriticalSection cs_insert;
+    uint64_t nInserts;
+    uint64_t nEvictions;
+    uint32_t nKickRand;
+
+    static void Split(const uint256& digest, uint64_t w[4]);
+    static bool Match(const Slot& slot, const uint64_t w[4]);
+    static void Store(Slot& slot, const uint64_t w[4]);
+    static void Load(const Slot& slot, uint64_t w[4]);
+    Bucket& First(const uint64_t w[4]) { return vBuckets[w[2] & nBucketMask]; }
+    Bucket& Second(const uint64_t w[4]) { return vBuckets[w[3] & nBucketMask]; }
+    Slot* FindEmpty(Bucket& bucket);
+};
+
+#endif // BITCOIN_CUCKOOCACHE_H
@@ -5,12 +5,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 
 using namespace std;
@@ -290,11 +294,10 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
 }
 
 //instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, const CAmount nValueIn, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
 {
     //assign new variables to make it easier to read
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    unsigned int nTimeBlockFrom = pindexFrom->GetBlockTime();
 
     if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
@@ -310,7 +313,7 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
-    if (!GetKernelStakeModifier(blockFrom.GetHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
+    if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
         LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
         return false;
     }
@@ -350,8 +353,8 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
             LogPrintf("CheckStakeKernelHash() : using modifier %s at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
                 boost::lexical_cast<std::string>(nStakeModifier).c_str(), nStakeModifierHeight,
                 DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime).c_str(),
-                mapBlockIndex[blockFrom.GetHash()]->nHeight,
-                DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.GetBlockTime()).c_str());
+                pindexFrom->nHeight,
+                DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindexFrom->GetBlockTime()).c_str());
             LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
                 "0.3",
                 boost::lexical_cast<std::string>(nStakeModifier).c_str(),
@@ -366,41 +369,216 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+/** State shared by the worker threads of one CStakeKernelSearch::Search() call */
+struct CStakeKernelSearchState {
+    boost::mutex cs;
+    //! Lowest candidate index with a kernel so far, or the candidate count if none
+    size_t nFound;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+};
+
+static void StakeKernelSearchWorker(const std::vector<CStakeKernelSearch::Candidate>* pvCandidates, const std::vector<uint256>* pvTargets,
+    size_t nStart, size_t nStride, unsigned int nTimeTx, unsigned int nHashDrift, int nHeightStart, CStakeKernelSearchState* pstate)
+{
+    unsigned char vchKernel[CStakeKernelSearch::KERNEL_INPUT_SIZE];
+    for (size_t i = nStart; i < pvCandidates->size(); i += nStride) {
+        {
+            // another worker already found a kernel in an earlier candidate
+            boost::lock_guard<boost::mutex> lock(pstate->cs);
+            if (i > pstate->nFound)
+                return;
+        }
+
+        //new block came in, move on
+        if (chainActive.Height() != nHeightStart)
+            return;
+
+        const CStakeKernelSearch::Candidate& candidate = (*pvCandidates)[i];
+        if (nTimeTx < candidate.nTimeBlockFrom) // Transaction timestamp violation
+            continue;
+
+        memcpy(vchKernel, candidate.vchKernel, sizeof(vchKernel));
+        for (unsigned int j = 0; j < nHashDrift; j++) {
+            unsigned int nTryTime = nTimeTx + nHashDrift - j;
+            WriteLE32(&vchKernel[sizeof(vchKernel) - 4], nTryTime);
+            uint256 hashProofOfStake;
+            CHash256().Write(vchKernel, sizeof(vchKernel)).Finalize((unsigned char*)&hashProofOfStake);
+            if (hashProofOfStake < (*pvTargets)[i]) {
+                boost::lock_guard<boost::mutex> lock(pstate->cs);
+                if (i < pstate->nFound) {
+                    pstate->nFound = i;
+                    pstate->nTimeTx = nTryTime;
+                    pstate->hashProofOfStake = hashProofOfStake;
+                }
+                return;
+            }
+        }
+    }
+}
+
+void CStakeKernelSearch::Clear()
+{
+    vCandidates.clear();
+}
+
+bool CStakeKernelSearch::AddCandidate(const CBlockIndex* pindexFrom, const COutPoint& prevout, CAmount nValue)
+{
+    uint64_t nStakeModifier = 0;
+    int nStakeModifierHeight = 0;
+    int64_t nStakeModifierTime = 0;
+    if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
+        return false;
+
+    Candidate candidate;
+    candidate.prevout = prevout;
+    candidate.nValue = nValue;
+    candidate.nTimeBlockFrom = pindexFrom->GetBlockTime();
+
+    // same layout as stakeHash(), with a placeholder for nTimeTx
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier << candidate.nTimeBlockFrom << prevout.n << prevout.hash << (unsigned int)0;
+    assert(ss.size() == KERNEL_INPUT_SIZE);
+    memcpy(candidate.vchKernel, &ss[0], KERNEL_INPUT_SIZE);
+
+    vCandidates.push_back(candidate);
+    return true;
+}
+
+bool CStakeKernelSearch::Search(unsigned int nBits, unsigned int nTimeTx, unsigned int nHashDrift, size_t nFirst, int nThreads,
+    size_t& nFoundRet, unsigned int& nTimeTxRet, uint256& hashProofOfStakeRet) const
+{
+    if (nFirst >= vCandidates.size())
+        return false;
+
+    //grab difficulty
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    // per-candidate targets, weighted by coin amount as in stakeTargetHit()
+    std::vector<uint256> vTargets(vCandidates.size());
+    for (size_t i = nFirst; i < vCandidates.size(); i++)
+        vTargets[i] = (uint256(vCandidates[i].nValue) / 100) * bnTargetPerCoinDay;
+
+    CStakeKernelSearchState state;
+    state.nFound = vCandidates.size();
+    state.nTimeTx = 0;
+
+    size_t nRemaining = vCandidates.size() - nFirst;
+    nThreads = std::min(nThreads, (int)(nRemaining / STAKE_SEARCH_MIN_CANDIDATES_PER_THREAD) + 1);
+    int nHeightStart = chainActive.Height();
+    if (nThreads <= 1) {
+        StakeKernelSearchWorker(&vCandidates, &vTargets, nFirst, 1, nTimeTx, nHashDrift, nHeightStart, &state);
+    } else {
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&StakeKernelSearchWorker, &vCandidates, &vTargets, nFirst + i, nThreads, nTimeTx, nHashDrift, nHeightStart, &state));
+        threadGroup.join_all();
+    }
+
+    mapHashedBlocks.clear();
+    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+
+    if (state.nFound == vCandidates.size())
+        return false;
+
+    nFoundRet = state.nFound;
+    nTimeTxRet = state.nTimeTx;
+    hashProofOfStakeRet = state.hashProofOfStake;
+    if (fDebug)
+        LogPrintf("CStakeKernelSearch::Search() : kernel found prevout=%s nTimeBlockFrom=%u nTimeTx=%u hashProof=%s\n",
+            vCandidates[nFoundRet].prevout.ToString(), vCandidates[nFoundRet].nTimeBlockFrom, nTimeTxRet, hashProofOfStakeRet.ToString());
+    return true;
+}
+
+// Find the output spent by a coinstake kernel together with the index of the block
+// that contains it. The kernel hash only needs that block's header data, which is
+// already in mapBlockIndex, so the block itself is never read from disk.
+static bool GetKernelOutput(const COutPoint& prevout, CTxOut& txoutRet, const CBlockIndex*& pindexFromRet)
+{
+    AssertLockHeld(cs_main);
+
+    // Still unspent in the active chain: the coins cache has everything we need
+    const Coin& coin = pcoinsTip->AccessCoin(prevout);
+    if (!coin.IsSpent() && (int)coin.nHeight <= chainActive.Height()) {
+        txoutRet = coin.out;
+        pindexFromRet = chainActive[coin.nHeight];
+        return true;
+    }
+
+    // Already spent (the block is on a fork): read just the transaction at its txindex position
+    if (fTxIndex) {
+        CDiskTxPos postx;
+        if (!pblocktree->ReadTxIndex(prevout.hash, postx))
+            return false;
+        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s : OpenBlockFile failed", __func__);
+        CBlockHeader header;
+        CTransaction txPrev;
+        try {
+            file >> header;
+            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+            file >> txPrev;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        if (txPrev.GetHash() != prevout.hash)
+            return error("%s : txid mismatch", __func__);
+        if (prevout.n >= txPrev.vout.size())
+            return false;
+        txoutRet = txPrev.vout[prevout.n];
+
+        // Identify the containing block by its position on disk rather than by hashing the header
+        BlockMap::iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+        if (mi != mapBlockIndex.end()) {
+            const CBlockIndex* pindexNext = chainActive.Next(mi->second);
+            if (pindexNext && (pindexNext->nStatus & BLOCK_HAVE_DATA) && pindexNext->nFile == postx.nFile && pindexNext->nDataPos == postx.nPos) {
+                pindexFromRet = pindexNext;
+                return true;
+            }
+        }
+        mi = mapBlockIndex.find(header.GetHash());
+        if (mi == mapBlockIndex.end())
+            return false;
+        pindexFromRet = mi->second;
+        return true;
+    }
+
+    uint256 hashBlock;
+    CTransaction txPrev;
+    if (!GetTransaction(prevout.hash, txPrev, hashBlock, true) || prevout.n >= txPrev.vout.size())
+        return false;
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi == mapBlockIndex.end())
+        return false;
+    txoutRet = txPrev.vout[prevout.n];
+    pindexFromRet = mi->second;
+    return true;
+}
+
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake)
 {
-    const CTransaction tx = block.vtx[1];
+    const CTransaction& tx = block.vtx[1];
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
-    // First try finding the previous transaction in database
-    uint256 hashBlock;
-    CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
+    CTxOut txoutPrev;
+    const CBlockIndex* pindexFrom = NULL;
+    if (!GetKernelOutput(txin.prevout, txoutPrev, pindexFrom))
         return error("CheckProofOfStake() : INFO: read txPrev failed");
 
     //verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
+    if (!VerifyScript(txin.scriptSig, txoutPrev.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
         return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
 
-    CBlockIndex* pindex = NULL;
-    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
-    if (it != mapBlockIndex.end())
-        pindex = it->second;
-    else
-        return error("CheckProofOfStake() : read block failed");
-
-    // Read block header
-    CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
-        return error("CheckProofOfStake(): INFO: failed to find block");
-
     unsigned int nInterval = 0;
     unsigned int nTime = block.nTime;
-    if (!CheckStakeKernelHash(block.nBits, blockprev, txPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
+    if (!CheckStakeKernelHash(block.nBits, pindexFrom, txoutPrev.nValue, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
         return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s \n", tx.GetHash().ToString().c_str(), hashProofOfStake.ToString().c_str()); // may occur during initial download or if behind on block chain sync
 
     return true;
@@ -25,11 +25,57 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, const CAmount nValueIn, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+
+// Minimum number of candidates given to each CStakeKernelSearch worker thread
+static const unsigned int STAKE_SEARCH_MIN_CANDIDATES_PER_THREAD = 500;
+
+/**
+ * Searches many stake candidates for a kernel in one pass.
+ *
+ * Everything in the kernel hash that only depends on the coin (stake modifier, the
+ * time of the block holding it and the outpoint) is serialized once per candidate
+ * when it is added, so trying a timestamp is a single fixed-size double SHA-256
+ * with no stream allocation. The value-weighted target of every candidate is
+ * computed once per search, and candidates are spread over worker threads.
+ * Results are the same as calling CheckStakeKernelHash() on each candidate in turn.
+ */
+class CStakeKernelSearch
+{
+public:
+    //! Size of the kernel hash input: nStakeModifier, nTimeBlockFrom, prevout.n, prevout.hash, nTimeTx
+    static const size_t KERNEL_INPUT_SIZE = 8 + 4 + 4 + 32 + 4;
+
+    struct Candidate {
+        COutPoint prevout;
+        CAmount nValue;
+        unsigned int nTimeBlockFrom;
+        //! Serialized kernel hash input, nTimeTx is filled in per try
+        unsigned char vchKernel[KERNEL_INPUT_SIZE];
+    };
+
+    void Clear();
+    size_t Size() const { return vCandidates.size(); }
+    const Candidate& Get(size_t i) const { return vCandidates[i]; }
+
+    //! Add a coin held in the block at pindexFrom; fails if no stake modifier is available for it yet
+    bool AddCandidate(const CBlockIndex* pindexFrom, const COutPoint& prevout, CAmount nValue);
+
+    /**
+     * Look for the first candidate at or after nFirst that meets the target for nBits at any of
+     * the nHashDrift timestamps following nTimeTx, trying the latest timestamp first. On success
+     * nFoundRet, nTimeTxRet and hashProofOfStakeRet describe the kernel.
+     */
+    bool Search(unsigned int nBits, unsigned int nTimeTx, unsigned int nHashDrift, size_t nFirst, int nThreads,
+        size_t& nFoundRet, unsigned int& nTimeTxRet, uint256& hashProofOfStakeRet) const;
+
+private:
+    std::vector<Candidate> vCandidates;
+};
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
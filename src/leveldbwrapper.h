@@ -163,6 +163,18 @@ public:
         return WriteBatch(batch, true);
     }
 
+    //! Compact the keys from key_begin to key_end, e.g. to reclaim space after erasing them
+    template <typename K>
+    void CompactRange(const K& key_begin, const K& key_end)
+    {
+        CDataStream ssKeyBegin(SER_DISK, CLIENT_VERSION), ssKeyEnd(SER_DISK, CLIENT_VERSION);
+        ssKeyBegin << key_begin;
+        ssKeyEnd << key_end;
+        leveldb::Slice slKeyBegin(&ssKeyBegin[0], ssKeyBegin.size());
+        leveldb::Slice slKeyEnd(&ssKeyEnd[0], ssKeyEnd.size());
+        pdb->CompactRange(&slKeyBegin, &slKeyEnd);
+    }
+
     // not exactly clean encapsulation, but it's easiest for now
     leveldb::Iterator* NewIterator()
     {
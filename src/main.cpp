@@ -10,12 +10,14 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
+#include "masternode-helpers.h"
 #include "masternode-payments.h"
 #include "masternodeman.h"
 #include "merkleblock.h"
@@ -72,9 +74,11 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 
 unsigned int nStakeMinAge = 60 * 60;
@@ -172,6 +176,9 @@ map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 /** Number of blocks in flight with validated headers. */
 int nQueuedValidatedHeaders = 0;
 
+/** Proof-of-stake headers accepted without their block, so without a stake kernel check, and the peer that sent each. */
+map<uint256, NodeId> mapUnverifiedHeaders;
+
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
@@ -180,6 +187,16 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
+
+/** A proof-of-stake block downloaded before its parent was connected, see ProcessStakePendingBlocks. */
+struct CStakePendingBlock {
+    CBlock block;
+    NodeId nodeid;
+    size_t nSize;
+};
+/** Blocks waiting for their parent to be connected, unstored, as their stake kernel can't be checked before. */
+map<uint256, CStakePendingBlock> mapStakePendingBlocks;
+size_t nStakePendingSize = 0;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -294,6 +311,12 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Compact block from this peer waiting for the "blocktxn" answer to our "getblocktxn".
+    PartiallyDownloadedBlock partialBlock;
+    //! Number of this peer's entries in mapUnverifiedHeaders.
+    int nUnverifiedHeaders;
+    //! Whether we stopped asking this peer for headers because too many of them are unverified.
+    bool fUnverifiedHeadersFull;
 
     CNodeState()
     {
@@ -307,6 +330,8 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        nUnverifiedHeaders = 0;
+        fUnverifiedHeadersFull = false;
     }
 };
 
@@ -369,6 +394,15 @@ void FinalizeNode(NodeId nodeid)
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
+    // Headers of this peer that are still unverified no longer count against the limits
+    map<uint256, NodeId>::iterator it = mapUnverifiedHeaders.begin();
+    while (it != mapUnverifiedHeaders.end()) {
+        if (it->second == nodeid)
+            mapUnverifiedHeaders.erase(it++);
+        else
+            it++;
+    }
+
     mapNodeState.erase(nodeid);
 }
 
@@ -402,6 +436,36 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, CBlockIndex* pindex
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
 
+// Requires cs_main.
+bool CanAddUnverifiedHeader(NodeId nodeid)
+{
+    CNodeState* state = State(nodeid);
+    return state != NULL && state->nUnverifiedHeaders < (int)MAX_UNVERIFIED_HEADERS_PER_PEER &&
+           mapUnverifiedHeaders.size() < MAX_UNVERIFIED_HEADERS;
+}
+
+// Requires cs_main.
+void AddUnverifiedHeader(const uint256& hash, NodeId nodeid)
+{
+    CNodeState* state = State(nodeid);
+    if (state != NULL && mapUnverifiedHeaders.insert(std::make_pair(hash, nodeid)).second)
+        state->nUnverifiedHeaders++;
+}
+
+/** Forget a header whose block has been checked. Returns the peer that sent the header, or -1. Requires cs_main. */
+NodeId EraseUnverifiedHeader(const uint256& hash)
+{
+    map<uint256, NodeId>::iterator it = mapUnverifiedHeaders.find(hash);
+    if (it == mapUnverifiedHeaders.end())
+        return -1;
+    NodeId nodeid = it->second;
+    CNodeState* state = State(nodeid);
+    if (state != NULL)
+        state->nUnverifiedHeaders--;
+    mapUnverifiedHeaders.erase(it);
+    return nodeid;
+}
+
 /** Check whether the last unknown block a peer advertized is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid)
 {
@@ -519,6 +583,9 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             if (pindex->nStatus & BLOCK_HAVE_DATA) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
+            } else if (mapStakePendingBlocks.count(pindex->GetBlockHash())) {
+                // Downloaded, waiting in memory for its parent to be connected
+                continue;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
                 if (pindex->nHeight > nWindowEnd) {
@@ -541,6 +608,12 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     }
 }
 
+/** Whether we sync with this peer by requesting headers, and blocks from them in parallel, instead of getblocks */
+bool static IsHeadersFirstPeer(const CNode* pnode)
+{
+    return Params().HeadersFirstSyncingActive() && pnode->nVersion >= HEADERS_FIRST_VERSION;
+}
+
 } // anon namespace
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
@@ -877,11 +950,11 @@ int GetInputAge(CTxIn& vin)
         CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
         view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
-        const CCoins* coins = view.AccessCoins(vin.prevout.hash);
+        const Coin& coin = view.AccessCoin(vin.prevout);
 
-        if (coins) {
-            if (coins->nHeight < 0) return 0;
-            return (chainActive.Tip()->nHeight + 1) - coins->nHeight;
+        if (!coin.IsSpent()) {
+            if ((int)coin.nHeight < 0) return 0;
+            return (chainActive.Tip()->nHeight + 1) - (int)coin.nHeight;
         } else
             return -1;
     }
@@ -894,9 +967,12 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
     if (nResult < 0) nResult = 0;
 
     if (nResult < 6) {
-        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-        if (i != mapTxLocks.end()) {
-            sigs = (*i).second.CountSignatures();
+        {
+            LOCK(cs_swifttx);
+            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
+            if (i != mapTxLocks.end()) {
+                sigs = (*i).second.CountSignatures();
+            }
         }
         if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
             return nSwiftTXDepth + nResult;
@@ -910,9 +986,12 @@ int GetIXConfirmations(uint256 nTXHash)
 {
     int sigs = 0;
 
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()) {
-        sigs = (*i).second.CountSignatures();
+    {
+        LOCK(cs_swifttx);
+        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
+        if (i != mapTxLocks.end()) {
+            sigs = (*i).second.CountSignatures();
+        }
     }
     if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
         return nSwiftTXDepth;
@@ -1091,7 +1170,21 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
+void static LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+{
+    int expired = pool.Expire(GetTime() - age);
+    if (expired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit);
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fRejectInsaneFee, ignoreFees);
+}
+
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1124,12 +1217,15 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
     // ----------- swiftTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
+    {
+        LOCK(cs_swifttx);
+        BOOST_FOREACH (const CTxIn& in, tx.vin) {
+            if (mapLockedInputs.count(in.prevout)) {
+                if (mapLockedInputs[in.prevout] != tx.GetHash()) {
+                    return state.DoS(0,
+                        error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
+                        REJECT_INVALID, "tx-lock-conflict");
+                }
             }
         }
     }
@@ -1157,15 +1253,19 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
             CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
             view.SetBackend(viewMemPool);
 
-            // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
+            // do we already have it? Only look at the outputs the coins cache already holds:
+            // probing the database for every output of every new transaction would be a
+            // disk read per output, and the mempool itself was checked above.
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                if (pcoinsTip->HaveCoinInCache(COutPoint(hash, i)))
+                    return false;
+            }
 
             // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // only helps filling in pfMissingInputs (to determine missing vs spent).
+            // A spent input cannot be told apart from one we have not seen yet,
+            // so both are reported through pfMissingInputs.
             for (const CTxIn txin : tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1207,7 +1307,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainActive.Height(), nSigOps);
         unsigned int nSize = entry.GetTxSize();
 
         if (!ignoreFees) {
@@ -1217,6 +1317,14 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                                         hash.ToString(), nFees, txMinFee),
                     REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+            // Once the pool has been full, only pay rates above what was evicted get in. Transactions
+            // coming back from disconnected blocks were in a block already and are let back in.
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (fLimitFree && mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+                return state.DoS(0, error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                                        hash.ToString(), nFees, mempoolRejectFee),
+                    REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Require that free transactions have sufficient priority to be mined in the next block.
             if (GetBoolArg("-relaypriority", true) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
@@ -1251,9 +1359,22 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 hash.ToString(),
                 nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
+        // Keep chains of unconfirmed transactions short, every walk over a package in the pool is bounded by them
+        {
+            LOCK(pool.cs);
+            std::set<uint256> setAncestors;
+            std::string errString;
+            if (!pool.CalculateMemPoolAncestors(entry, setAncestors, GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT),
+                    GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000, GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT),
+                    GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000, errString))
+                return state.DoS(0, error("AcceptToMemoryPool : %s %s", errString, hash.ToString()),
+                    REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        PrecomputedTransactionData txdata(tx);
+        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, NULL, &txdata)) {
             return error("AcceptToMemoryPool: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1266,12 +1387,17 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
+        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, NULL, &txdata)) {
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
+
+        // Make room, possibly for the transaction just added
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, NULL);
@@ -1308,12 +1434,15 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
     // ----------- swiftTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
+    {
+        LOCK(cs_swifttx);
+        BOOST_FOREACH (const CTxIn& in, tx.vin) {
+            if (mapLockedInputs.count(in.prevout)) {
+                if (mapLockedInputs[in.prevout] != tx.GetHash()) {
+                    return state.DoS(0,
+                        error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
+                        REJECT_INVALID, "tx-lock-conflict");
+                }
             }
         }
     }
@@ -1341,15 +1470,19 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
             CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
             view.SetBackend(viewMemPool);
 
-            // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
+            // do we already have it? Only look at the outputs the coins cache already holds:
+            // probing the database for every output of every new transaction would be a
+            // disk read per output, and the mempool itself was checked above.
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                if (pcoinsTip->HaveCoinInCache(COutPoint(hash, i)))
+                    return false;
+            }
 
             // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // only helps filling in pfMissingInputs (to determine missing vs spent).
+            // A spent input cannot be told apart from one we have not seen yet,
+            // so both are reported through pfMissingInputs.
             for (const CTxIn txin : tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1393,7 +1526,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), nSigOps);
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1505,10 +1638,9 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
-                CCoinsViewCache& view = *pcoinsTip;
-                const CCoins* coins = view.AccessCoins(hash);
-                if (coins)
-                    nHeight = coins->nHeight;
+                const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+                if (!coin.IsSpent())
+                    nHeight = coin.nHeight;
             }
             if (nHeight > 0)
                 pindexSlow = chainActive[nHeight];
@@ -1558,6 +1690,31 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
+bool GetAddressIndex(unsigned char type, const uint160& hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int nStart, int nEnd)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressIndex(type, hashBytes, addressIndex, nStart, nEnd))
+        return error("%s : unable to get txids for address", __func__);
+    return true;
+}
+
+bool GetAddressUnspent(unsigned char type, const uint160& hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressUnspentIndex(type, hashBytes, unspentOutputs))
+        return error("%s : unable to get unspent outputs for address", __func__);
+    return true;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
@@ -1831,26 +1988,27 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-            txundo.vprevout.push_back(CTxInUndo());
-            bool ret = inputs.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, txundo.vprevout.back());
+            Coin coin;
+            bool ret = inputs.SpendCoin(txin.prevout, &coin);
             assert(ret);
+            txundo.vprevout.push_back(CTxInUndo(coin));
         }
     }
 
     // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks, const PrecomputedTransactionData* txdata)
 {
     if (!tx.IsCoinBase()) {
         if (pvChecks)
@@ -1869,20 +2027,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         CAmount nFees = 0;
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             const COutPoint& prevout = tx.vin[i].prevout;
-            const CCoins* coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase() || coins->IsCoinStake()) {
-                if (nSpendHeight - coins->nHeight < Params().COINBASE_MATURITY())
+            if (coin.IsCoinBase() || coin.IsCoinStake()) {
+                if (nSpendHeight - (int)coin.nHeight < Params().COINBASE_MATURITY())
                     return state.Invalid(
-                        error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - coins->nHeight, coins->IsCoinStake()),
+                        error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - (int)coin.nHeight, coin.IsCoinStake()),
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase");
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, error("CheckInputs() : txin values out of range"),
                     REJECT_INVALID, "bad-txns-inputvalues-outofrange");
         }
@@ -1913,11 +2071,11 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(coin.out.scriptPubKey, tx, i, flags, cacheStore, txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1929,8 +2087,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                        CScriptCheck check(coin.out.scriptPubKey, tx, i,
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1950,7 +2108,33 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+/**
+ * Put a spent output back into the view. Returns false when the view did not
+ * look as expected, which only makes the disconnect unclean.
+ */
+static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+{
+    bool fClean = true;
+    if (view.HaveCoin(out))
+        fClean = error("DisconnectBlock() : undo data overwriting existing output");
+
+    Coin coin(undo.txout, undo.nHeight, undo.fCoinBase, undo.fCoinStake);
+    if (undo.nHeight == 0) {
+        // Undo data written before coins were stored per output only carries the
+        // metadata for the last spent output of a transaction. Any other output
+        // of it is still unspent here and has the same metadata.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("DisconnectBlock() : undo data adding output to missing transaction");
+        coin.nHeight = alternate.nHeight;
+        coin.fCoinBase = alternate.fCoinBase;
+        coin.fCoinStake = alternate.fCoinStake;
+    }
+    view.AddCoin(out, coin, !fClean);
+    return fClean;
+}
+
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fUpdateIndexes, bool* pfClean)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -1971,31 +2155,31 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
         uint256 hash = tx.GetHash();
 
         // Check that all outputs are available and match the outputs in the block itself
-        // exactly. Note that transactions with only provably unspendable outputs won't
-        // have outputs available even in the block itself, so we handle that case
-        // specially with outsEmpty.
-        {
-            CCoins outsEmpty;
-            CCoinsModifier outs = view.ModifyCoins(hash);
-            outs->ClearUnspendable();
-
-            CCoins outsBlock(tx, pindex->nHeight);
-            // The CCoins serialization does not serialize negative numbers.
-            // No network rules currently depend on the version here, so an inconsistency is harmless
-            // but it must be corrected before txout nversion ever influences a network rule.
-            if (outsBlock.nVersion < 0)
-                outs->nVersion = outsBlock.nVersion;
-            if (*outs != outsBlock)
+        // exactly, and remove them. Provably unspendable outputs were never added.
+        for (unsigned int o = 0; o < tx.vout.size(); o++) {
+            if (tx.vout[o].scriptPubKey.IsUnspendable())
+                continue;
+            unsigned char addressType;
+            uint160 hashBytes;
+            if (fUpdateIndexes && fAddressIndex && GetAddressIndexKey(tx.vout[o].scriptPubKey, addressType, hashBytes)) {
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, o, false), tx.vout[o].nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, hash, o), CAddressUnspentValue()));
+            }
+            Coin coin;
+            bool fSpent = view.SpendCoin(COutPoint(hash, o), &coin);
+            if (!fSpent || tx.vout[o] != coin.out || (int)coin.nHeight != pindex->nHeight ||
+                coin.fCoinBase != tx.IsCoinBase() || coin.fCoinStake != tx.IsCoinStake())
                 fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
-
-            // remove outputs
-            outs->Clear();
         }
 
         // restore inputs
@@ -2006,28 +2190,35 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint& out = tx.vin[j].prevout;
                 const CTxInUndo& undo = txundo.vprevout[j];
-                CCoinsModifier coins = view.ModifyCoins(out.hash);
-                if (undo.nHeight != 0) {
-                    // undo data contains height: this is the last output of the prevout tx being spent
-                    if (!coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
-                    coins->Clear();
-                    coins->fCoinBase = undo.fCoinBase;
-                    coins->nHeight = undo.nHeight;
-                    coins->nVersion = undo.nVersion;
-                } else {
-                    if (coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
+                if (!ApplyTxInUndo(undo, view, out))
+                    fClean = false;
+
+                if (fUpdateIndexes) {
+                    const Coin& coin = view.AccessCoin(out);
+                    unsigned char addressType;
+                    uint160 hashBytes;
+                    if (fAddressIndex && !coin.IsSpent() && GetAddressIndexKey(coin.out.scriptPubKey, addressType, hashBytes)) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), -coin.out.nValue));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, out.hash, out.n), CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight)));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
                 }
-                if (coins->IsAvailable(out.n))
-                    fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
-                if (coins->vout.size() < out.n + 1)
-                    coins->vout.resize(out.n + 1);
-                coins->vout[out.n] = undo.txout;
             }
         }
     }
 
+    if (fUpdateIndexes) {
+        if (fAddressIndex) {
+            if (!pblocktree->EraseAddressIndex(addressIndex))
+                return state.Abort("Failed to delete address index");
+            if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+                return state.Abort("Failed to write address unspent index");
+        }
+        if (fSpentIndex && !pblocktree->UpdateSpentIndex(spentIndex))
+            return state.Abort("Failed to write spent index");
+    }
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2078,6 +2269,54 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/**
+ * Fill in the proof-of-stake fields of a block index entry when its block is connected. An entry
+ * created from a header alone has none of them, and the stake modifier depends on the fields of
+ * the ancestors, so they are final only once every ancestor is connected.
+ */
+bool static UpdateBlockIndexStake(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
+{
+    uint256 hash = block.GetHash();
+
+    if (block.IsProofOfStake()) {
+        if (pindex->hashProofOfStake == 0) {
+            map<uint256, uint256>::iterator it = mapProofOfStake.find(hash);
+            if (it != mapProofOfStake.end()) {
+                pindex->hashProofOfStake = it->second;
+            } else {
+                // The kernel was checked before the block was stored, but mapProofOfStake is not kept across restarts
+                uint256 hashProofOfStake;
+                if (!CheckProofOfStake(block, hashProofOfStake))
+                    return state.DoS(100, error("%s : check proof-of-stake failed for block %s", __func__, hash.ToString()),
+                        REJECT_INVALID, "bad-cs-kernel");
+                mapProofOfStake.insert(make_pair(hash, hashProofOfStake));
+                pindex->hashProofOfStake = hashProofOfStake;
+            }
+        }
+        pindex->SetProofOfStake();
+        pindex->prevoutStake = block.vtx[1].vin[0].prevout;
+        pindex->nStakeTime = block.nTime;
+        setStakeSeen.insert(make_pair(pindex->prevoutStake, pindex->nStakeTime));
+    }
+
+    if (pindex->pprev) {
+        pindex->bnChainTrust = pindex->pprev->bnChainTrust + pindex->GetBlockTrust();
+
+        uint64_t nStakeModifier = 0;
+        bool fGeneratedStakeModifier = false;
+        if (!ComputeNextStakeModifier(pindex->pprev, nStakeModifier, fGeneratedStakeModifier))
+            LogPrintf("%s : ComputeNextStakeModifier() failed \n", __func__);
+        pindex->nFlags &= ~CBlockIndex::BLOCK_STAKE_MODIFIER;
+        pindex->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+        pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
+        if (!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
+            LogPrintf("%s : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", __func__, pindex->nHeight, boost::lexical_cast<std::string>(nStakeModifier));
+    }
+    setDirtyBlockIndex.insert(pindex);
+
+    return true;
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
 {
     AssertLockHeld(cs_main);
@@ -2106,6 +2345,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, error("ConnectBlock() : PoW period ended"),
             REJECT_INVALID, "PoW-ended");
 
+    if (!fJustCheck && !UpdateBlockIndexStake(block, state, pindex))
+        return false;
+
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -2123,10 +2365,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     bool fEnforceBIP30 = !pindex->phashBlock; // Enforce on CreateNewBlock invocations which don't have a hash.
     if (fEnforceBIP30) {
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx.GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"),
-                    REJECT_INVALID, "bad-txns-BIP30");
+            for (unsigned int o = 0; o < tx.vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx.GetHash(), o)))
+                    return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"),
+                        REJECT_INVALID, "bad-txns-BIP30");
+            }
         }
     }
 
@@ -2143,6 +2386,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CBlockUndo blockundo;
 
+    // Script checks may run on other threads until control is waited on, so this
+    // outlives it, and is reserved up front so that no element moves
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
+
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
@@ -2152,6 +2400,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
     CAmount nValueIn = 0;
@@ -2184,13 +2435,42 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 nFees += view.GetValueIn(tx) - tx.GetValueOut();
             nValueIn += view.GetValueIn(tx);
 
+            txdata.push_back(fScriptChecks ? PrecomputedTransactionData(tx) : PrecomputedTransactionData());
             std::vector<CScriptCheck> vChecks;
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
+            // Connecting for real erases the cache entries this block uses; a block that is only checked
+            // (TestBlockValidity) leaves them, and adds its own, for the block that does get connected
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fJustCheck, nScriptCheckThreads ? &vChecks : NULL, &txdata.back()))
                 return false;
             control.Add(vChecks);
         }
         nValueOut += tx.GetValueOut();
 
+        if (fAddressIndex || fSpentIndex) {
+            // The spent coins are still in the view until UpdateCoins below
+            const uint256& txhash = tx.GetHash();
+            for (unsigned int j = 0; j < tx.vin.size() && !tx.IsCoinBase(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const Coin& coin = view.AccessCoin(prevout);
+                unsigned char addressType = ADDRESS_INDEX_NONE;
+                uint160 hashBytes(0);
+                if (GetAddressIndexKey(coin.out.scriptPubKey, addressType, hashBytes) && fAddressIndex) {
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), -coin.out.nValue));
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                }
+                if (fSpentIndex)
+                    spentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, coin.out.nValue, addressType, hashBytes)));
+            }
+            for (unsigned int o = 0; o < tx.vout.size() && fAddressIndex; o++) {
+                const CTxOut& out = tx.vout[o];
+                unsigned char addressType;
+                uint160 hashBytes;
+                if (!GetAddressIndexKey(out.scriptPubKey, addressType, hashBytes))
+                    continue;
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, o, false), out.nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, o), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -2256,6 +2536,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (fAddressIndex) {
+        if (!pblocktree->WriteAddressIndex(addressIndex))
+            return state.Abort("Failed to write address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return state.Abort("Failed to write address unspent index");
+    }
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return state.Abort("Failed to write spent index");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2283,18 +2574,24 @@ enum FlushStateMode {
 
 /**
  * Update the on-disk chain state.
- * The caches and indexes are flushed if either they're too large, forceWrite is set, or
- * fast is not set and it's been a while since the last write.
+ * The caches and indexes are written if either the coins cache is too large, forceWrite is set, or
+ * fast is not set and it's been a while since the last write. The coins cache is only emptied when
+ * it is too large; otherwise its dirty entries are written and the rest stays cached.
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
-            (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
-            // Typical CCoins structures on disk are around 100 bytes in size.
+        size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // The cache is close to the limit and we are between blocks: empty it now rather than in the middle of connecting one.
+        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0 / 9) > nCoinCacheUsage;
+        // The cache is over the limit, we have to write now.
+        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
+        // It's been a while since we wrote the block index and chain state to disk.
+        bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000;
+        if (mode == FLUSH_STATE_ALWAYS || fCacheLarge || fCacheCritical || fPeriodicWrite) {
+            // Typical Coin entries on disk are well under 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
             // an overestimation, as most will delete an existing entry or
@@ -2323,8 +2620,13 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             }
             pblocktree->Sync();
             // Finally flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            if (fCacheLarge || fCacheCritical) {
+                LogPrint("coindb", "Flushing coins cache of %.1fMiB (limit %.1fMiB)\n", cacheSize * (1.0 / (1 << 20)), nCoinCacheUsage * (1.0 / (1 << 20)));
+                if (!pcoinsTip->Flush())
+                    return state.Abort("Failed to write to coin database");
+            } else if (!pcoinsTip->Sync()) {
                 return state.Abort("Failed to write to coin database");
+            }
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 g_signals.SetBestChain(chainActive.GetLocator());
@@ -2352,10 +2654,10 @@ void static UpdateTip(CBlockIndex* pindexNew)
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utxo)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -2394,7 +2696,7 @@ bool static DisconnectTip(CValidationState& state)
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        if (!DisconnectBlock(block, state, pindexDelete, view, true))
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
@@ -2775,10 +3077,31 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             // Relay inventory, but don't relay old inventory during initial block download.
             int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
             {
+                // Peers that asked for compact blocks get the new tip itself instead of an inv
+                CInv inv(MSG_BLOCK, hashNewTip);
+                bool fCompact = pblock && pblock->GetHash() == hashNewTip;
+                CBlockHeaderAndShortTxIDs cmpctblock;
+                if (fCompact)
+                    cmpctblock = CBlockHeaderAndShortTxIDs(*pblock);
+
                 LOCK(cs_vNodes);
-                BOOST_FOREACH (CNode* pnode, vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                BOOST_FOREACH (CNode* pnode, vNodes) {
+                    if (chainActive.Height() <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                        continue;
+                    if (fCompact && pnode->fPreferCompactBlocks) {
+                        bool fKnown;
+                        {
+                            LOCK(pnode->cs_inventory);
+                            fKnown = pnode->setInventoryKnown.count(inv);
+                        }
+                        if (!fKnown) {
+                            pnode->PushMessage("cmpctblock", cmpctblock);
+                            pnode->AddInventoryKnown(inv);
+                        }
+                    } else {
+                        pnode->PushInventory(inv);
+                    }
+                }
             }
             // Notify external listeners about the new tip.
             uiInterface.NotifyBlockTip(hashNewTip);
@@ -2863,6 +3186,16 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+/**
+ * Whether the work of a block index entry has been checked in full. A proof-of-stake header doesn't carry
+ * the stake kernel, so until its block is stored, which needs a kernel check, it doesn't count towards
+ * pindexBestHeader.
+ */
+bool static IsStakeVerified(const CBlockIndex* pindex)
+{
+    return pindex->nHeight <= Params().LAST_POW_BLOCK() || (pindex->nStatus & BLOCK_HAVE_DATA);
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -2920,7 +3253,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    if (IsStakeVerified(pindexNew) && (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork))
         pindexBestHeader = pindexNew;
 
     //update previous block pointer
@@ -2946,6 +3279,11 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
     pindexNew->RaiseValidity(BLOCK_VALID_TRANSACTIONS);
     setDirtyBlockIndex.insert(pindexNew);
 
+    // The stake kernel was checked before the block was stored
+    EraseUnverifiedHeader(pindexNew->GetBlockHash());
+    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+        pindexBestHeader = pindexNew;
+
     if (pindexNew->pprev == NULL || pindexNew->pprev->nChainTx) {
         // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
         deque<CBlockIndex*> queue;
@@ -3133,6 +3471,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // ----------- swiftTX transaction scanning -----------
     if (IsSporkActive(SPORK_3_SWIFTTX_BLOCK_FILTERING)) {
+        LOCK(cs_swifttx);
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
             if (!tx.IsCoinBase()) {
                 //only reject blocks when it's based on complete consensus
@@ -3198,7 +3537,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     return true;
 }
 
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
+bool CheckWork(const CBlock& block, CBlockIndex* const pindexPrev)
 {
     if (pindexPrev == NULL)
         return error("%s : null pindexPrev for block %s", __func__, block.GetHash().ToString().c_str());
@@ -3233,6 +3572,36 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
     return true;
 }
 
+bool CheckBlockHeaderWork(const CBlockHeader& block, CValidationState& state, CBlockIndex* const pindexPrev)
+{
+    const int nHeight = pindexPrev->nHeight + 1;
+    unsigned int nBitsRequired = GetNextWorkRequired(pindexPrev, &block);
+
+    // Without the transactions the height tells the kind of block, proof-of-work ends at LAST_POW_BLOCK
+    if (nHeight <= Params().LAST_POW_BLOCK()) {
+        if (!CheckProofOfWork(block.GetHash(), block.nBits))
+            return state.DoS(50, error("%s : proof of work failed at %d", __func__, nHeight),
+                REJECT_INVALID, "high-hash");
+
+        double n1 = ConvertBitsToDouble(block.nBits);
+        double n2 = ConvertBitsToDouble(nBitsRequired);
+        if (abs(n1 - n2) > n1 * 0.5)
+            return state.DoS(100, error("%s : incorrect proof of work (DGW pre-fork) at %d", __func__, nHeight),
+                REJECT_INVALID, "bad-diffbits");
+    } else {
+        // The stake kernel can only be checked once the block arrives, see UpdateBlockIndexStake
+        if (block.nBits != nBitsRequired)
+            return state.DoS(100, error("%s : incorrect proof of stake target at %d", __func__, nHeight),
+                REJECT_INVALID, "bad-diffbits");
+
+        if (block.GetBlockTime() > GetAdjustedTime() + 180)
+            return state.Invalid(error("%s : block timestamp too far in the future", __func__),
+                REJECT_INVALID, "time-too-new");
+    }
+
+    return true;
+}
+
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* const pindexPrev)
 {
     uint256 hash = block.GetHash();
@@ -3396,8 +3765,21 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         }
     }
 
-    if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev))
+    // No block is stored before its stake kernel is checked, see IsStakePending for blocks that arrive out of order
+    if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev)) {
+        // On top of our tip the check is final: the header is invalid, and so was sending it without the block
+        if (pindexPrev == chainActive.Tip()) {
+            BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
+            if (mi != mapBlockIndex.end()) {
+                mi->second->nStatus |= BLOCK_FAILED_VALID;
+                setDirtyBlockIndex.insert(mi->second);
+            }
+            NodeId nodeid = EraseUnverifiedHeader(block.GetHash());
+            if (nodeid != -1)
+                Misbehaving(nodeid, 100);
+        }
         return false;
+    }
 
     if (!AcceptBlockHeader(block, state, &pindex))
         return false;
@@ -3499,6 +3881,74 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+/**
+ * Whether a proof-of-stake block arrived before its parent was connected. The stake kernel is checked
+ * against the active chain, which may not contain the staked output or its stake modifier yet, so such
+ * a block is held in memory until all its ancestors are stored.
+ */
+bool static IsStakePending(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!block.IsProofOfStake())
+        return false;
+    BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+    return mi != mapBlockIndex.end() && mi->second->nChainTx == 0 && !(mi->second->nStatus & BLOCK_FAILED_MASK);
+}
+
+bool static AddStakePendingBlock(const CBlock& block, NodeId nodeid)
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = block.GetHash();
+    if (mapStakePendingBlocks.count(hash))
+        return true;
+    size_t nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    if (nStakePendingSize + nSize > MAX_STAKE_PENDING_SIZE)
+        return false;
+    CStakePendingBlock& pending = mapStakePendingBlocks[hash];
+    pending.block = block;
+    pending.nodeid = nodeid;
+    pending.nSize = nSize;
+    nStakePendingSize += nSize;
+    return true;
+}
+
+/** Store and connect the held blocks whose ancestors have all been stored since they arrived */
+void static ProcessStakePendingBlocks()
+{
+    while (true) {
+        CStakePendingBlock pending;
+        {
+            LOCK(cs_main);
+            map<uint256, CStakePendingBlock>::iterator it = mapStakePendingBlocks.begin();
+            while (it != mapStakePendingBlocks.end() && IsStakePending(it->second.block))
+                it++;
+            if (it == mapStakePendingBlocks.end())
+                return;
+            pending = it->second;
+            nStakePendingSize -= pending.nSize;
+            mapStakePendingBlocks.erase(it);
+
+            CValidationState state;
+            CBlockIndex* pindex = NULL;
+            if (!AcceptBlock(pending.block, state, &pindex, NULL, true)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && nDoS > 0)
+                    Misbehaving(pending.nodeid, nDoS);
+                LogPrintf("%s : AcceptBlock FAILED for block %s\n", __func__, pending.block.GetHash().GetHex());
+                continue;
+            }
+            mapBlockSource[pindex->GetBlockHash()] = pending.nodeid;
+            CheckBlockIndex();
+        }
+
+        CValidationState state;
+        if (!ActivateBestChain(state, &pending.block, true)) {
+            error("%s : ActivateBestChain failed", __func__);
+            return;
+        }
+    }
+}
+
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
 {
     // Preliminary checks
@@ -3519,7 +3969,10 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
         if (mi == mapBlockIndex.end()) {
-            pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
+            if (IsHeadersFirstPeer(pfrom))
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256(0));
+            else
+                pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
             return false;
         }
     }
@@ -3527,11 +3980,20 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     {
         LOCK(cs_main);   // Replaces the former TRY_LOCK loop because busy waiting wastes too much resources
 
+        bool fRequested = mapBlocksInFlight.count(pblock->GetHash()) != 0;
         MarkBlockAsReceived (pblock->GetHash ());
         if (!checked) {
             return error ("%s : CheckBlock FAILED for block %s", __func__, pblock->GetHash().GetHex());
         }
 
+        // Only blocks we asked for are held, anything else is dropped and fetched again when it fits
+        if (pfrom && IsStakePending(*pblock)) {
+            if (!fRequested || !AddStakePendingBlock(*pblock, pfrom->GetId()))
+                return error("%s : block %s arrived before its parent was connected", __func__, pblock->GetHash().GetHex());
+            LogPrint("net", "%s : holding block %s until its parent is connected\n", __func__, pblock->GetHash().GetHex());
+            return true;
+        }
+
         // Store to disk
         CBlockIndex* pindex = NULL;
         bool ret = AcceptBlock (*pblock, state, &pindex, dbp, checked);
@@ -3546,6 +4008,8 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     if (!ActivateBestChain(state, pblock, checked))
         return error("%s : ActivateBestChain failed", __func__);
 
+    ProcessStakePendingBlocks();
+
     if (!fLiteMode) {
         if (masternodeSync.RequestedMasternodeAssets > MASTERNODE_SYNC_LIST) {
             masternodePayments.ProcessBlock(GetHeight() + 10);
@@ -3681,12 +4145,13 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(string& strError)
 {
-    if (!pblocktree->LoadBlockIndexGuts())
+    if (!pblocktree->LoadBlockIndexGuts(GetBoolArg("-verifyblockindexhashes", false)))
         return false;
 
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
+    int64_t nStart = GetTimeMillis();
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     for (const PAIRTYPE(uint256, CBlockIndex*) & item : mapBlockIndex) {
@@ -3715,11 +4180,13 @@ bool static LoadBlockIndexDB(string& strError)
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
-        if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
+        if (pindex->IsValid(BLOCK_VALID_TREE) && IsStakeVerified(pindex) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    LogPrintf("%s: linked %u block index entries in %dms\n", __func__, vSortedByHeight.size(), GetTimeMillis() - nStart);
 
     // Load block file info
+    nStart = GetTimeMillis();
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
     LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
@@ -3751,6 +4218,7 @@ bool static LoadBlockIndexDB(string& strError)
             return false;
         }
     }
+    LogPrintf("%s: loaded block file info in %dms\n", __func__, GetTimeMillis() - nStart);
 
     //Check if the shutdown procedure was followed on last client exit
     bool fLastShutdownWasPrepared = true;
@@ -3832,6 +4300,12 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address and spent indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3901,9 +4375,9 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            if (!DisconnectBlock(block, state, pindex, coins, false, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
@@ -3965,6 +4439,12 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+
+    // Use the provided settings for -addressindex and -spentindex in the new database
+    fAddressIndex = GetBoolArg("-addressindex", false);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", false);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4303,15 +4783,20 @@ bool static AlreadyHave(const CInv& inv)
         bool txInMap = false;
         txInMap = mempool.exists(inv.hash);
         return txInMap || mapOrphanTransactions.count(inv.hash) ||
-               pcoinsTip->HaveCoins(inv.hash);
+               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) ||
+               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
     }
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
-    case MSG_TXLOCK_REQUEST:
+    case MSG_TXLOCK_REQUEST: {
+        LOCK(cs_swifttx);
         return mapTxLockReq.count(inv.hash) ||
                mapTxLockReqRejected.count(inv.hash);
-    case MSG_TXLOCK_VOTE:
+    }
+    case MSG_TXLOCK_VOTE: {
+        LOCK(cs_swifttx);
         return mapTxLockVote.count(inv.hash);
+    }
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
@@ -4456,22 +4941,30 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
-                        pushed = true;
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    {
+                        LOCK(cs_swifttx);
+                        if (mapTxLockVote.count(inv.hash)) {
+                            ss.reserve(1000);
+                            ss << mapTxLockVote[inv.hash];
+                            pushed = true;
+                        }
                     }
+                    if (pushed)
+                        pfrom->PushMessage("txlvote", ss);
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("ix", ss);
-                        pushed = true;
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    {
+                        LOCK(cs_swifttx);
+                        if (mapTxLockReq.count(inv.hash)) {
+                            ss.reserve(1000);
+                            ss << mapTxLockReq[inv.hash];
+                            pushed = true;
+                        }
                     }
+                    if (pushed)
+                        pfrom->PushMessage("ix", ss);
                 }
                 if (!pushed && inv.type == MSG_SPORK) {
                     if (mapSporks.count(inv.hash)) {
@@ -4579,6 +5072,35 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+// Masternode, budget, SwiftTX and spork messages
+void static ProcessExtensionMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv)
+{
+    mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+    budget.ProcessMessage(pfrom, strCommand, vRecv);
+    masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
+    ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
+    ProcessSpork(pfrom, strCommand, vRecv);
+    masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+}
+
+// Validate a block received in full or rebuilt from a compact block and punish the peer if it is invalid
+void static ProcessReceivedBlock(CNode* pfrom, CBlock& block, const string& strCommand)
+{
+    CValidationState state;
+    ProcessNewBlock(state, pfrom, &block);
+    int nDoS;
+    if(state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if(nDoS > 0) {
+            TRY_LOCK(cs_main, lockMain);
+            if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+    //disconnect this node if its old protocol version
+    pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -4715,6 +5237,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     else if (strCommand == "verack") {
         pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
 
+        // Ask the peer to announce new blocks to us as compact blocks
+        if (pfrom->nVersion >= COMPACT_BLOCKS_VERSION)
+            pfrom->PushMessage("sendcmpct", true, COMPACT_BLOCKS_PROTOCOL);
+
         // Mark this node as currently connected, so we update its timestamp later.
         if (pfrom->fNetworkNode) {
             LOCK(cs_main);
@@ -4813,9 +5339,17 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    if (IsHeadersFirstPeer(pfrom)) {
+                        // Ask for the headers leading to the announced block, the block itself is then
+                        // requested along with the others in SendMessages. When the block builds on our
+                        // tip there are no such headers and the answer is just its own.
+                        pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
+                        LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    } else {
+                        // Add this to the list of blocks to request
+                        vToFetch.push_back(inv);
+                        LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    }
                 }
             }
 
@@ -4852,7 +5386,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
+    else if (strCommand == "getblocks") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -4884,7 +5418,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == "getheaders") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -5057,9 +5591,28 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 return error("non-continuous headers sequence");
             }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
+            // Headers already known were checked when they were accepted
+            bool fUnverified = false;
+            if (!mapBlockIndex.count(header.GetHash())) {
+                BlockMap::iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+                if (mi != mapBlockIndex.end() && !CheckBlockHeaderWork(header, state, mi->second)) {
+                    int nDoS;
+                    if (state.IsInvalid(nDoS) && nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    return error("invalid header received %s", header.GetHash().ToString());
+                }
+
+                // Proof-of-stake headers stay unverified until their blocks arrive, so only a limited number
+                // is taken ahead of the blocks. The rest is asked for again once enough blocks are stored.
+                fUnverified = mi != mapBlockIndex.end() && mi->second->nHeight >= Params().LAST_POW_BLOCK();
+                if (fUnverified && !CanAddUnverifiedHeader(pfrom->GetId())) {
+                    State(pfrom->GetId())->fUnverifiedHeadersFull = true;
+                    LogPrint("net", "too many unverified headers, pausing headers sync with peer=%d\n", pfrom->id);
+                    break;
+                }
+            }
+
+            // AcceptBlockHeader takes a CBlock, a header converts to one without transactions
             if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
@@ -5069,12 +5622,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     return error(strError.c_str());
                 }
             }
+            if (fUnverified && mapBlockIndex.count(header.GetHash()))
+                AddUnverifiedHeader(header.GetHash(), pfrom->GetId());
         }
 
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (nCount == MAX_HEADERS_RESULTS && pindexLast && !State(pfrom->GetId())->fUnverifiedHeadersFull) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
@@ -5094,7 +5649,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(block.hashPrevBlock)) {
+        if (!mapBlockIndex.count(block.hashPrevBlock) && IsHeadersFirstPeer(pfrom)) {
+            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hashBlock);
+        } else if (!mapBlockIndex.count(block.hashPrevBlock)) {
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
                 pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
@@ -5107,20 +5664,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         } else {
             pfrom->AddInventoryKnown(inv);
 
-            CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
-                ProcessNewBlock(state, pfrom, &block);
-                int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                                       state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
-                }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+            // With headers first the block is usually known, but not its data
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                ProcessReceivedBlock(pfrom, block, strCommand);
             } else {
                 LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
             }
@@ -5128,6 +5675,149 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == "sendcmpct") {
+        bool fAnnounce = false;
+        uint64_t nCmpctVersion = 0;
+        vRecv >> fAnnounce >> nCmpctVersion;
+        if (nCmpctVersion == COMPACT_BLOCKS_PROTOCOL)
+            pfrom->fPreferCompactBlocks = fAnnounce;
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        CInv inv(MSG_BLOCK, hashBlock);
+        LogPrint("net", "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+        pfrom->AddInventoryKnown(inv);
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                return true;
+
+            // Like an unconnected "block", catch up to it first
+            BlockMap::iterator miPrev = mapBlockIndex.find(cmpctblock.header.hashPrevBlock);
+            if (miPrev == mapBlockIndex.end()) {
+                if (IsHeadersFirstPeer(pfrom))
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hashBlock);
+                else
+                    pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
+                return true;
+            }
+
+            // Don't scan the mempool for a header that could not be part of a valid block
+            CValidationState state;
+            if (!CheckBlockHeaderWork(cmpctblock.header, state, miPrev->second)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return true;
+            }
+
+            PartiallyDownloadedBlock partialBlock;
+            ReadStatus status;
+            {
+                LOCK(mempool.cs);
+                status = partialBlock.InitData(cmpctblock, mempool);
+            }
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid cmpctblock %s from peer=%d", hashBlock.ToString(), pfrom->id);
+            }
+
+            MarkBlockAsInFlight(pfrom->GetId(), hashBlock, mi != mapBlockIndex.end() ? mi->second : NULL);
+            if (status == READ_STATUS_FAILED) {
+                // Short id collision inside the block, download it in full
+                pfrom->PushMessage("getdata", vector<CInv>(1, inv));
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            req.blockhash = hashBlock;
+            req.indexes = partialBlock.GetMissing();
+            if (!req.indexes.empty()) {
+                State(pfrom->GetId())->partialBlock = partialBlock;
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
+            }
+
+            if (partialBlock.FillBlock(block, vector<CTransaction>()) != READ_STATUS_OK) {
+                pfrom->PushMessage("getdata", vector<CInv>(1, inv));
+                return true;
+            }
+        }
+        ProcessReceivedBlock(pfrom, block, strCommand);
+    }
+
+
+    else if (strCommand == "getblocktxn") {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        // Only recent blocks are served in parts, anything older goes out in full
+        if (!chainActive.Contains(mi->second) || chainActive.Height() - mi->second->nHeight >= MAX_BLOCKTXN_DEPTH) {
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, mi->second))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (nodestate->partialBlock.IsNull() || nodestate->partialBlock.GetBlockHash() != resp.blockhash) {
+                LogPrint("net", "peer %d sent us block transactions for a block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            ReadStatus status = nodestate->partialBlock.FillBlock(block, resp.txn);
+            nodestate->partialBlock = PartiallyDownloadedBlock();
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us invalid block transactions for %s", pfrom->id, resp.blockhash.ToString());
+            } else if (status == READ_STATUS_FAILED) {
+                // A short id matched the wrong mempool transaction, download the full block
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash)));
+                return true;
+            }
+        }
+        ProcessReceivedBlock(pfrom, block, strCommand);
+    }
+
+
     // This asymmetric behavior for inbound and outbound connections was introduced
     // to prevent a fingerprinting attack: an attacker can send specific fake addresses
     // to users' AddrMan and later request them by sending getaddr messages.
@@ -5342,12 +6032,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
     } else {
         //probably one the extensions
-        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-        budget.ProcessMessage(pfrom, strCommand, vRecv);
-        masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
-        ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
-        ProcessSpork(pfrom, strCommand, vRecv);
-        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        ProcessExtensionMessage(pfrom, strCommand, vRecv);
     }
 
 
@@ -5376,6 +6061,84 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+//
+// Message statistics
+//
+// Processing time of every received message per command. Masternode, budget and spork messages
+// stay on the message handler thread: their handlers share the masternode, budget and spork state
+// with the rest of the node without locks of their own, and read chain state without cs_main.
+//
+
+/** Number of distinct commands tracked, the rest is counted as "other" so peers can't grow the map */
+static const size_t MAX_MESSAGE_STATS_COMMANDS = 64;
+
+static CCriticalSection cs_mapMessageStats;
+static std::map<string, CMessageStats> mapMessageStats;
+
+static CMessageStats& MessageStats(const string& strCommand)
+{
+    AssertLockHeld(cs_mapMessageStats);
+    std::map<string, CMessageStats>::iterator mi = mapMessageStats.find(strCommand);
+    if (mi != mapMessageStats.end())
+        return mi->second;
+    if (mapMessageStats.size() >= MAX_MESSAGE_STATS_COMMANDS)
+        return mapMessageStats["other"];
+    return mapMessageStats[strCommand];
+}
+
+static void RecordMessageStats(const string& strCommand, int64_t nTime)
+{
+    LOCK(cs_mapMessageStats);
+    CMessageStats& stats = MessageStats(strCommand);
+    stats.nProcessed++;
+    stats.nTimeTotal += nTime;
+    stats.nTimeMax = std::max(stats.nTimeMax, nTime);
+}
+
+void GetMessageStats(std::map<string, CMessageStats>& mapStatsRet)
+{
+    LOCK(cs_mapMessageStats);
+    mapStatsRet = mapMessageStats;
+}
+
+static bool IsSignedMasternodeMessage(const string& strCommand)
+{
+    return strCommand == "mnb" || strCommand == "mnp" || strCommand == "mnw" || strCommand == "mvote" || strCommand == "fbvote" || strCommand == "txlvote";
+}
+
+// Verify the signatures of the run of complete masternode messages at the front of the receive queue
+// in parallel. A masternode or budget sync sends thousands of them in a row. They are still processed
+// one at a time and in order, but the signature check then finds the result ready.
+// requires LOCK(cs_vRecvMsg)
+static void BatchVerifyMasternodeSignatures(CNode* pfrom)
+{
+    std::vector<CMasternodeSignatureCheck> vChecks;
+    unsigned int nMessages = 0;
+    for (std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin(); it != pfrom->vRecvMsg.end() && nMessages < MAX_SIGNATURE_BATCH_MESSAGES; ++it, ++nMessages) {
+        CNetMessage& msg = *it;
+        if (!msg.complete() || msg.fSignatureChecked || !msg.hdr.IsValid())
+            break;
+        string strCommand = msg.hdr.GetCommand();
+        if (!IsSignedMasternodeMessage(strCommand))
+            break;
+        msg.fSignatureChecked = true;
+
+        try {
+            CDataStream vRecv(msg.vRecv);
+            mnodeman.AddSignatureChecks(strCommand, vRecv, vChecks);
+            budget.AddSignatureChecks(strCommand, vRecv, vChecks);
+            masternodePayments.AddSignatureChecks(strCommand, vRecv, vChecks);
+            AddSignatureChecksSwiftTX(strCommand, vRecv, vChecks);
+        } catch (std::exception& e) {
+            // Malformed messages are dealt with when they are processed
+        }
+    }
+
+    // A single message is checked when it's processed, like without a batch
+    if (vChecks.size() > 1)
+        masternodeSigner.VerifyBatch(vChecks);
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -5398,6 +6161,9 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    if (!pfrom->vRecvMsg.empty() && !pfrom->vRecvMsg.front().fSignatureChecked)
+        BatchVerifyMasternodeSignatures(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -5450,6 +6216,7 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        int64_t nTimeStart = GetTimeMicros();
         try {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
             boost::this_thread::interruption_point();
@@ -5471,6 +6238,7 @@ bool ProcessMessages(CNode* pfrom)
         } catch (...) {
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
+        RecordMessageStats(strCommand, GetTimeMicros() - nTimeStart);
 
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -5592,13 +6360,26 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
-                pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                if (IsHeadersFirstPeer(pto)) {
+                    // Start from the parent of our best header, so even a peer with nothing new answers
+                    // with that header and we learn which blocks it can serve
+                    CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
+                } else {
+                    pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                }
             }
         }
 
+        // Continue a headers sync paused by the unverified headers limits once half of them are verified
+        if (state.fUnverifiedHeadersFull && state.nUnverifiedHeaders <= (int)MAX_UNVERIFIED_HEADERS_PER_PEER / 2 &&
+            mapUnverifiedHeaders.size() <= MAX_UNVERIFIED_HEADERS / 2 && state.pindexBestKnownBlock != NULL) {
+            state.fUnverifiedHeadersFull = false;
+            LogPrint("net", "resuming headers sync (%d) with peer=%d\n", state.pindexBestKnownBlock->nHeight, pto->id);
+            pto->PushMessage("getheaders", chainActive.GetLocator(state.pindexBestKnownBlock), uint256(0));
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -5771,6 +6552,172 @@ std::string CBlockFileInfo::ToString() const
     return strprintf("CBlockFileInfo(blocks=%u, size=%u, heights=%u...%u, time=%s...%s)", nBlocks, nSize, nHeightFirst, nHeightLast, DateTimeStrFormat("%Y-%m-%d", nTimeFirst), DateTimeStrFormat("%Y-%m-%d", nTimeLast));
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+bool LoadMempool()
+{
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t nStart = GetTimeMillis();
+    int64_t nNow = GetTime();
+    int count = 0, failed = 0, expired = 0, already_there = 0, locks = 0;
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION)
+            return error("%s : unknown mempool file version %d", __func__, version);
+
+        // SwiftTX locks first, so that nothing conflicting with a locked transaction gets back in
+        uint64_t nLocks;
+        file >> nLocks;
+        while (nLocks--) {
+            CTransaction tx;
+            CTransactionLock txLock;
+            file >> tx >> txLock;
+            if (txLock.nExpiration > nNow && RestoreTransactionLock(tx, txLock))
+                locks++;
+        }
+
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            CTransaction tx;
+            int64_t nTime;
+            double dPriorityDelta;
+            CAmount nFeeDelta;
+            file >> tx >> nTime >> dPriorityDelta >> nFeeDelta;
+
+            if (dPriorityDelta != 0 || nFeeDelta != 0)
+                mempool.PrioritiseTransaction(tx.GetHash(), tx.GetHash().ToString(), dPriorityDelta, nFeeDelta);
+
+            if (nTime + nExpiryTimeout > nNow) {
+                LOCK(cs_main);
+                CValidationState state;
+                if (mempool.exists(tx.GetHash()))
+                    already_there++;
+                else if (AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime))
+                    count++;
+                else
+                    failed++;
+            } else {
+                expired++;
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+
+        // Deltas of transactions that were not in the pool
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (std::map<uint256, std::pair<double, CAmount> >::iterator it = mapDeltas.begin(); it != mapDeltas.end(); it++)
+            mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    double dElapsed = std::max(GetTimeMillis() - nStart, (int64_t)1) * 0.001;
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there, %i SwiftTX locks in %.2fs (%.0f tx/s)\n",
+        count, failed, expired, already_there, locks, dElapsed, (count + failed + already_there) / dElapsed);
+    return true;
+}
+
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMicros();
+
+    // Parents go before their children so that every transaction finds its inputs on load
+    std::vector<CTxMemPoolEntry> vEntries;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        vEntries.reserve(mempool.mapTx.size());
+        std::set<uint256> setDone;
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.begin(); it != mempool.mapTx.end(); it++) {
+            std::vector<std::map<uint256, CTxMemPoolEntry>::const_iterator> vStack(1, it);
+            while (!vStack.empty()) {
+                std::map<uint256, CTxMemPoolEntry>::const_iterator itCur = vStack.back();
+                if (setDone.count(itCur->first)) {
+                    vStack.pop_back();
+                    continue;
+                }
+                bool fParentsDone = true;
+                BOOST_FOREACH (const CTxIn& txin, itCur->second.GetTx().vin) {
+                    std::map<uint256, CTxMemPoolEntry>::const_iterator itParent = mempool.mapTx.find(txin.prevout.hash);
+                    if (itParent != mempool.mapTx.end() && !setDone.count(itParent->first)) {
+                        vStack.push_back(itParent);
+                        fParentsDone = false;
+                    }
+                }
+                if (fParentsDone) {
+                    setDone.insert(itCur->first);
+                    vEntries.push_back(itCur->second);
+                    vStack.pop_back();
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<CTransaction, CTransactionLock> > vLocks;
+    {
+        LOCK(cs_swifttx);
+        for (std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin(); it != mapTxLocks.end(); it++) {
+            std::map<uint256, CTransaction>::iterator itReq = mapTxLockReq.find(it->first);
+            if (itReq != mapTxLockReq.end())
+                vLocks.push_back(std::make_pair(itReq->second, it->second));
+        }
+    }
+
+    int64_t nMid = GetTimeMicros();
+
+    try {
+        boost::filesystem::path pathTmp = GetDataDir() / "mempool.dat.new";
+        FILE* filestr = fopen(pathTmp.string().c_str(), "wb");
+        if (!filestr)
+            return false;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << MEMPOOL_DUMP_VERSION;
+
+        file << (uint64_t)vLocks.size();
+        for (unsigned int i = 0; i < vLocks.size(); i++)
+            file << vLocks[i].first << vLocks[i].second;
+
+        file << (uint64_t)vEntries.size();
+        BOOST_FOREACH (const CTxMemPoolEntry& entry, vEntries) {
+            const uint256& hash = entry.GetTx().GetHash();
+            std::pair<double, CAmount> deltas(0, 0);
+            std::map<uint256, std::pair<double, CAmount> >::iterator itDelta = mapDeltas.find(hash);
+            if (itDelta != mapDeltas.end()) {
+                deltas = itDelta->second;
+                mapDeltas.erase(itDelta);
+            }
+            file << entry.GetTx() << entry.GetTime() << deltas.first << deltas.second;
+        }
+
+        file << mapDeltas;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathTmp, GetDataDir() / "mempool.dat");
+
+        int64_t nLast = GetTimeMicros();
+        LogPrintf("Dumped mempool: %u transactions, %u SwiftTX locks, %gs to copy, %gs to dump\n",
+            vEntries.size(), vLocks.size(), (nMid - nStart) * 0.000001, (nLast - nMid) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 
 class CMainCleanup
 {
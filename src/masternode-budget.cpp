@@ -994,6 +994,34 @@ void CBudgetManager::NewBlock()
     LogPrint("masternode","CBudgetManager::NewBlock - PASSED\n");
 }
 
+void CBudgetManager::AddSignatureChecks(std::string& strCommand, CDataStream& vRecv, std::vector<CMasternodeSignatureCheck>& vChecks)
+{
+    if (fLiteMode) return;
+    if (!masternodeSync.IsBlockchainSynced()) return;
+
+    LOCK(cs_budget);
+
+    if (strCommand == "mvote") {
+        CBudgetVote vote;
+        vRecv >> vote;
+
+        if (mapSeenMasternodeBudgetVotes.count(vote.GetHash())) return;
+
+        CMasternode* pmn = mnodeman.Find(vote.vin);
+        if (pmn != NULL)
+            vChecks.push_back(CMasternodeSignatureCheck(pmn->pubKeyMasternode, vote.vchSig, vote.GetSignatureMessage()));
+    } else if (strCommand == "fbvote") {
+        CFinalizedBudgetVote vote;
+        vRecv >> vote;
+
+        if (mapSeenFinalizedBudgetVotes.count(vote.GetHash())) return;
+
+        CMasternode* pmn = mnodeman.Find(vote.vin);
+        if (pmn != NULL)
+            vChecks.push_back(CMasternodeSignatureCheck(pmn->pubKeyMasternode, vote.vchSig, vote.GetSignatureMessage()));
+    }
+}
+
 void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     // lite mode is not supported
@@ -1705,10 +1733,15 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     return true;
 }
 
+std::string CBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -2149,11 +2182,16 @@ bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     return true;
 }
 
+std::string CFinalizedBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
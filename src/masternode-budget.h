@@ -66,6 +66,7 @@ public:
     CBudgetVote(CTxIn vin, uint256 nProposalHash, int nVoteIn);
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
+    std::string GetSignatureMessage() const;
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
 
@@ -118,6 +119,7 @@ public:
     CFinalizedBudgetVote(CTxIn vinIn, uint256 nBudgetHashIn);
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
+    std::string GetSignatureMessage() const;
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
 
@@ -215,6 +217,7 @@ public:
 
     void Calculate();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+    void AddSignatureChecks(std::string& strCommand, CDataStream& vRecv, std::vector<CMasternodeSignatureCheck>& vChecks);
     void NewBlock();
     CBudgetProposal* FindProposal(const std::string& strProposalName);
     CBudgetProposal* FindProposal(uint256 nHash);
@@ -5,6 +5,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "masternode-helpers.h"
+#include "checkqueue.h"
 #include "init.h"
 #include "main.h"
 #include "masternodeman.h"
@@ -141,8 +142,62 @@ bool CMasternodeSigner::SignMessage(std::string strMessage, std::string& errorMe
     return true;
 }
 
+/** Maximum number of batch verified signatures waiting for their message to be processed */
+static const size_t MAX_VERIFIED_SIGNATURES = 50000;
+
+static CCheckQueue<CMasternodeSignatureCheck> mnsigcheckqueue(32);
+
+// Signatures found valid by VerifyBatch, each one is accepted once by VerifyMessage
+static CCriticalSection cs_setVerifiedSignatures;
+static std::set<uint256> setVerifiedSignatures;
+
+static uint256 VerifiedSignatureHash(const CPubKey& pubkey, const vector<unsigned char>& vchSig, const std::string& strMessage)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << pubkey.GetID() << vchSig << strMessage;
+    return ss.GetHash();
+}
+
+bool CMasternodeSignatureCheck::operator()()
+{
+    std::string errorMessage;
+    if (!masternodeSigner.VerifyMessage(pubkey, vchSig, strMessage, errorMessage))
+        return true;
+
+    uint256 hash = VerifiedSignatureHash(pubkey, vchSig, strMessage);
+    LOCK(cs_setVerifiedSignatures);
+    // Messages that are dropped before their signature is checked leave their entry behind
+    if (setVerifiedSignatures.size() >= MAX_VERIFIED_SIGNATURES)
+        setVerifiedSignatures.erase(setVerifiedSignatures.begin());
+    setVerifiedSignatures.insert(hash);
+    return true;
+}
+
+void ThreadMasternodeSignatureCheck()
+{
+    RenameThread("pandemia-mnsigch");
+    mnsigcheckqueue.Thread();
+}
+
+void CMasternodeSigner::VerifyBatch(std::vector<CMasternodeSignatureCheck>& vChecks)
+{
+    // Without script check threads VerifyMessage might as well verify them as they come
+    if (nScriptCheckThreads == 0)
+        return;
+
+    CCheckQueueControl<CMasternodeSignatureCheck> control(&mnsigcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 bool CMasternodeSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
 {
+    {
+        LOCK(cs_setVerifiedSignatures);
+        if (!setVerifiedSignatures.empty() && setVerifiedSignatures.erase(VerifiedSignatureHash(pubkey, vchSig, strMessage)))
+            return true;
+    }
+
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
@@ -12,6 +12,29 @@
 #include "base58.h"
 #include "amount.h"
 
+/** A masternode message signature verified ahead of processing the message, see CMasternodeSigner::VerifyBatch
+ */
+class CMasternodeSignatureCheck
+{
+public:
+    CPubKey pubkey;
+    std::vector<unsigned char> vchSig;
+    std::string strMessage;
+
+    CMasternodeSignatureCheck() {}
+    CMasternodeSignatureCheck(const CPubKey& pubkeyIn, const std::vector<unsigned char>& vchSigIn, const std::string& strMessageIn) : pubkey(pubkeyIn), vchSig(vchSigIn), strMessage(strMessageIn) {}
+
+    /// Verify the signature and remember it if valid. Always succeeds, so one bad signature doesn't stop the rest of the batch
+    bool operator()();
+
+    void swap(CMasternodeSignatureCheck& check)
+    {
+        std::swap(pubkey, check.pubkey);
+        vchSig.swap(check.vchSig);
+        strMessage.swap(check.strMessage);
+    }
+};
+
 /** Helper object for signing and checking signatures
  */
 class CMasternodeSigner
@@ -29,6 +52,8 @@ public:
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    /// Verify a batch of signatures in parallel, VerifyMessage then accepts the valid ones without verifying them again
+    void VerifyBatch(std::vector<CMasternodeSignatureCheck>& vChecks);
 
     bool SetCollateralAddress(std::string strAddress);
 
@@ -42,6 +67,8 @@ public:
 };
 
 void ThreadMasternodePool();
+/** Run an instance of the masternode signature checking thread */
+void ThreadMasternodeSignatureCheck();
 
 extern CMasternodeSigner masternodeSigner;
 
@@ -354,6 +354,27 @@ int CMasternodePayments::GetMinMasternodePaymentsProto()
         return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT; // Also allow old peers as long as they are allowed to run
 }
 
+void CMasternodePayments::AddSignatureChecks(std::string& strCommand, CDataStream& vRecv, std::vector<CMasternodeSignatureCheck>& vChecks)
+{
+    if (!masternodeSync.IsBlockchainSynced()) return;
+
+    if (fLiteMode) return; //disable all Masternode related functionality
+
+    if (strCommand == "mnw") {
+        CMasternodePaymentWinner winner;
+        vRecv >> winner;
+
+        {
+            LOCK(cs_mapMasternodePayeeVotes);
+            if (mapMasternodePayeeVotes.count(winner.GetHash())) return;
+        }
+
+        CMasternode* pmn = mnodeman.Find(winner.vinMasternode);
+        if (pmn != NULL)
+            vChecks.push_back(CMasternodeSignatureCheck(pmn->pubKeyMasternode, winner.vchSig, winner.GetSignatureMessage()));
+    }
+}
+
 void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (!masternodeSync.IsBlockchainSynced()) return;
@@ -770,14 +791,19 @@ void CMasternodePaymentWinner::Relay()
     RelayInv(inv);
 }
 
+std::string CMasternodePaymentWinner::GetSignatureMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CMasternodePaymentWinner::SignatureValid()
 {
     CMasternode* pmn = mnodeman.Find(vinMasternode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetSignatureMessage();
 
         std::string errorMessage = "";
         if (!masternodeSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
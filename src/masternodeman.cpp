@@ -25,9 +25,9 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-        const pair<int64_t, CTxIn>& t2) const
+struct CompareScoreIndex {
+    bool operator()(const pair<int64_t, size_t>& t1,
+        const pair<int64_t, size_t>& t2) const
     {
         return t1.first < t2.first;
     }
@@ -207,6 +207,8 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        IndexMasternode(vMasternodes.size() - 1);
+        InvalidateRankings();
         return true;
     }
 
@@ -245,6 +247,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
+    size_t nSizeBefore = vMasternodes.size();
     vector<CMasternode>::iterator it = vMasternodes.begin();
     while (it != vMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
@@ -277,10 +280,13 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            InvalidateRankings();
         } else {
             ++it;
         }
     }
+    if (vMasternodes.size() != nSizeBefore)
+        RebuildIndexes();
 
     // check who's asked for the Masternode list
     map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
@@ -338,6 +344,8 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    RebuildIndexes();
+    InvalidateRankings();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -432,28 +440,71 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
+void CMasternodeMan::IndexMasternode(size_t nIndex)
+{
+    AssertLockHeld(cs);
+    const CMasternode& mn = vMasternodes[nIndex];
+
+    // Keys can be shared or left behind by an update; keep the earliest entry that still matches
+    mapIndexByOutpoint[mn.vin.prevout] = nIndex;
+
+    CScript payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+    std::pair<std::map<CScript, size_t>::iterator, bool> retPayee = mapIndexByPayee.insert(make_pair(payee, nIndex));
+    if (!retPayee.second) {
+        size_t nOther = retPayee.first->second;
+        if (nOther >= nIndex || GetScriptForDestination(vMasternodes[nOther].pubKeyCollateralAddress.GetID()) != payee)
+            retPayee.first->second = nIndex;
+    }
+
+    std::pair<std::map<CPubKey, size_t>::iterator, bool> retPubKey = mapIndexByPubKey.insert(make_pair(mn.pubKeyMasternode, nIndex));
+    if (!retPubKey.second) {
+        size_t nOther = retPubKey.first->second;
+        if (nOther >= nIndex || vMasternodes[nOther].pubKeyMasternode != mn.pubKeyMasternode)
+            retPubKey.first->second = nIndex;
+    }
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    AssertLockHeld(cs);
+    mapIndexByOutpoint.clear();
+    mapIndexByPayee.clear();
+    mapIndexByPubKey.clear();
+    for (size_t i = 0; i < vMasternodes.size(); i++)
+        IndexMasternode(i);
+}
+
+void CMasternodeMan::UpdateIndexes(const CTxIn& vin)
+{
+    LOCK(cs);
+    std::map<COutPoint, size_t>::const_iterator it = mapIndexByOutpoint.find(vin.prevout);
+    if (it != mapIndexByOutpoint.end())
+        IndexMasternode(it->second);
+}
+
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    std::map<CScript, size_t>::const_iterator it = mapIndexByPayee.find(payee);
+    if (it == mapIndexByPayee.end())
+        return NULL;
+
+    // the entry may have been updated with another key since it was indexed
+    CMasternode& mn = vMasternodes[it->second];
+    if (GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()) != payee)
+        return NULL;
+    return &mn;
 }
 
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    std::map<COutPoint, size_t>::const_iterator it = mapIndexByOutpoint.find(vin.prevout);
+    if (it == mapIndexByOutpoint.end())
+        return NULL;
+    return &vMasternodes[it->second];
 }
 
 
@@ -461,11 +512,15 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+    std::map<CPubKey, size_t>::const_iterator it = mapIndexByPubKey.find(pubKeyMasternode);
+    if (it == mapIndexByPubKey.end())
+        return NULL;
+
+    // the entry may have been updated with another key since it was indexed
+    CMasternode& mn = vMasternodes[it->second];
+    if (mn.pubKeyMasternode != pubKeyMasternode)
+        return NULL;
+    return &mn;
 }
 
 //
@@ -566,73 +621,115 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
 
 CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMasternode* winner = NULL;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
+    LOCK(cs);
 
-        // calculate the score for each Masternode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    // the winner is the best scoring enabled Masternode
+    const CMasternodeRanking* pranking = GetRanking(nBlockHeight, minProtocol, RANK_ONLY_ACTIVE);
+    if (pranking == NULL || pranking->vecRanked.empty())
+        return NULL;
 
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
-        }
-    }
+    return &vMasternodes[pranking->vecRanked.front()];
+}
 
-    return winner;
+void CMasternodeMan::InvalidateRankings()
+{
+    LOCK(cs);
+    mapScores.clear();
+    mapRankings.clear();
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+const CMasternodeScores* CMasternodeMan::GetScores(int64_t& nBlockHeight)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-    int64_t nMasternode_Min_Age = GetSporkValue(SPORK_16_MN_WINNER_MINIMUM_AGE);
-    int64_t nMasternode_Age = 0;
+    AssertLockHeld(cs);
+
+    if (chainActive.Tip() == NULL) return NULL;
+    if (nBlockHeight == 0) nBlockHeight = chainActive.Tip()->nHeight;
 
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    if (!GetBlockHash(hash, nBlockHeight)) return NULL;
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) {
-            LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
-            continue;                                                       // Skip obsolete versions
-        }
+    std::map<int64_t, CMasternodeScores>::iterator it = mapScores.find(nBlockHeight);
+    if (it != mapScores.end() && it->second.hashBlock == hash)
+        return &it->second;
 
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
-            if ((nMasternode_Age) < nMasternode_Min_Age) {
-                if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
-                continue;                                                   // Skip masternodes younger than (default) 1 hour
-            }
-        }
-        if (fOnlyActive) {
+    // rankings at this height came from scores that are missing or from another block
+    std::map<RankingKey, CMasternodeRanking>::iterator itRanking = mapRankings.lower_bound(make_pair(nBlockHeight, make_pair(std::numeric_limits<int>::min(), std::numeric_limits<int>::min())));
+    while (itRanking != mapRankings.end() && itRanking->first.first == nBlockHeight)
+        mapRankings.erase(itRanking++);
+
+    // only keep the most recent heights, votes are checked against a narrow window
+    if (it == mapScores.end() && mapScores.size() >= MASTERNODES_RANKING_HEIGHTS) {
+        int64_t nOldestHeight = mapScores.begin()->first;
+        mapScores.erase(mapScores.begin());
+        itRanking = mapRankings.begin();
+        while (itRanking != mapRankings.end() && itRanking->first.first == nOldestHeight)
+            mapRankings.erase(itRanking++);
+    }
+
+    CMasternodeScores& scores = mapScores[nBlockHeight];
+    scores.hashBlock = hash;
+    scores.vecScores.clear();
+    scores.vecScores.reserve(vMasternodes.size());
+    for (size_t i = 0; i < vMasternodes.size(); i++) {
+        uint256 n = vMasternodes[i].CalculateScore(1, nBlockHeight);
+        scores.vecScores.push_back(make_pair(n.GetCompact(false), i));
+    }
+
+    sort(scores.vecScores.rbegin(), scores.vecScores.rend(), CompareScoreIndex());
+
+    return &scores;
+}
+
+const CMasternodeRanking* CMasternodeMan::GetRanking(int64_t nBlockHeight, int minProtocol, int nFilter)
+{
+    AssertLockHeld(cs);
+
+    const CMasternodeScores* pscores = GetScores(nBlockHeight);
+    if (pscores == NULL)
+        return NULL;
+
+    // Enabled state and age change over time, so filter again as often as Masternodes are checked
+    CMasternodeRanking& ranking = mapRankings[make_pair(nBlockHeight, make_pair(minProtocol, nFilter))];
+    if (ranking.nTimeFiltered != 0 && GetTime() - ranking.nTimeFiltered < MASTERNODE_CHECK_SECONDS)
+        return &ranking;
+
+    bool fMinAge = (nFilter & RANK_MIN_AGE) && IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    int64_t nMasternode_Min_Age = GetSporkValue(SPORK_16_MN_WINNER_MINIMUM_AGE);
+    int64_t nNow = GetAdjustedTime();
+
+    ranking.nTimeFiltered = GetTime();
+    ranking.vecRanked.clear();
+    ranking.mapRanks.clear();
+    BOOST_FOREACH (const PAIRTYPE(int64_t, size_t) & s, pscores->vecScores) {
+        CMasternode& mn = vMasternodes[s.second];
+        if (mn.protocolVersion < minProtocol) continue;                     // Skip obsolete versions
+        if (fMinAge && nNow - mn.sigTime < nMasternode_Min_Age) continue;   // Skip masternodes younger than (default) 1 hour
+        if (nFilter & RANK_ONLY_ACTIVE) {
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
 
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
+        ranking.vecRanked.push_back(s.second);
+        ranking.mapRanks[mn.vin.prevout] = ranking.vecRanked.size();
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    return &ranking;
+}
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (s.second.prevout == vin.prevout) {
-            return rank;
-        }
-    }
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
+
+    const CMasternodeRanking* pranking = GetRanking(nBlockHeight, minProtocol, RANK_MIN_AGE | (fOnlyActive ? RANK_ONLY_ACTIVE : 0));
+    if (pranking == NULL)
+        return -1;
+
+    std::map<COutPoint, int>::const_iterator it = pranking->mapRanks.find(vin.prevout);
+    if (it == pranking->mapRanks.end())
+        return -1;
 
-    return -1;
+    return it->second;
 }
 
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
@@ -640,12 +737,13 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
     std::vector<pair<int, CMasternode> > vecMasternodeRanks;
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
+    LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    const CMasternodeScores* pscores = GetScores(nBlockHeight);
+    if (pscores == NULL) return vecMasternodeRanks;
+
+    BOOST_FOREACH (const PAIRTYPE(int64_t, size_t) & s, pscores->vecScores) {
+        CMasternode& mn = vMasternodes[s.second];
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
@@ -655,10 +753,7 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn));
+        vecMasternodeScores.push_back(make_pair(s.first, mn));
     }
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
@@ -674,33 +769,13 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    LOCK(cs);
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
+    const CMasternodeRanking* pranking = GetRanking(nBlockHeight, minProtocol, fOnlyActive ? RANK_ONLY_ACTIVE : 0);
+    if (pranking == NULL || nRank < 1 || nRank > (int)pranking->vecRanked.size())
+        return NULL;
 
-    return NULL;
+    return &vMasternodes[pranking->vecRanked[nRank - 1]];
 }
 
 void CMasternodeMan::ProcessMasternodeConnections()
@@ -718,6 +793,30 @@ void CMasternodeMan::ProcessMasternodeConnections()
     }
 }
 
+void CMasternodeMan::AddSignatureChecks(std::string& strCommand, CDataStream& vRecv, std::vector<CMasternodeSignatureCheck>& vChecks)
+{
+    if (fLiteMode) return;
+
+    LOCK(cs_process_message);
+
+    if (strCommand == "mnb") {
+        CMasternodeBroadcast mnb;
+        vRecv >> mnb;
+
+        if (!mapSeenMasternodeBroadcast.count(mnb.GetHash()))
+            vChecks.push_back(CMasternodeSignatureCheck(mnb.pubKeyCollateralAddress, mnb.sig, mnb.GetSignatureMessage()));
+    } else if (strCommand == "mnp") {
+        CMasternodePing mnp;
+        vRecv >> mnp;
+
+        if (mapSeenMasternodePing.count(mnp.GetHash())) return;
+
+        CMasternode* pmn = Find(mnp.vin);
+        if (pmn != NULL)
+            vChecks.push_back(CMasternodeSignatureCheck(pmn->pubKeyMasternode, mnp.vchSig, mnp.GetSignatureMessage()));
+    }
+}
+
 void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (fLiteMode) return; //disable all Masternode related functionality
@@ -855,6 +954,8 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            RebuildIndexes();
+            InvalidateRankings();
             break;
         }
         ++it;
@@ -876,6 +977,8 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
             masternodeSync.AddedMasternodeList(mnb.GetHash());
         }
     } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+        UpdateIndexes(mnb.vin);
+        InvalidateRankings();
         masternodeSync.AddedMasternodeList(mnb.GetHash());
     }
 }
@@ -16,6 +16,7 @@
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_RANKING_HEIGHTS 20
 
 using namespace std;
 
@@ -48,6 +49,32 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
+/** Masternode scores for one block height, best first
+ */
+class CMasternodeScores
+{
+public:
+    // block the scores were calculated from
+    uint256 hashBlock;
+    // (score, index into the masternode list)
+    std::vector<std::pair<int64_t, size_t> > vecScores;
+};
+
+/** Masternodes that pass one set of filters at a block height, in rank order
+ */
+class CMasternodeRanking
+{
+public:
+    // when enabled state, age and protocol were last applied to the scores
+    int64_t nTimeFiltered;
+    // indices into the masternode list, rank 1 first
+    std::vector<size_t> vecRanked;
+    // rank of every entry in vecRanked
+    std::map<COutPoint, int> mapRanks;
+
+    CMasternodeRanking() : nTimeFiltered(0) {}
+};
+
 class CMasternodeMan
 {
 private:
@@ -66,6 +93,28 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // lookups into vMasternodes, rebuilt whenever entries are removed since that shifts the vector
+    std::map<COutPoint, size_t> mapIndexByOutpoint;
+    std::map<CScript, size_t> mapIndexByPayee;
+    std::map<CPubKey, size_t> mapIndexByPubKey;
+
+    void IndexMasternode(size_t nIndex);
+    void RebuildIndexes();
+
+    // filters applied on top of the scores when ranking
+    enum {
+        RANK_ONLY_ACTIVE = 1,
+        RANK_MIN_AGE = 2
+    };
+    typedef std::pair<int64_t, std::pair<int, int> > RankingKey;
+
+    // scores and rankings per block height, computed once and dropped whenever the list changes
+    std::map<int64_t, CMasternodeScores> mapScores;
+    std::map<RankingKey, CMasternodeRanking> mapRankings;
+
+    const CMasternodeScores* GetScores(int64_t& nBlockHeight);
+    const CMasternodeRanking* GetRanking(int64_t nBlockHeight, int minProtocol, int nFilter);
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -78,7 +127,11 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
+        if (ser_action.ForRead())
+            InvalidateRankings();
         READWRITE(vMasternodes);
+        if (ser_action.ForRead())
+            RebuildIndexes();
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -116,6 +169,9 @@ public:
     CMasternode* Find(const CTxIn& vin);
     CMasternode* Find(const CPubKey& pubKeyMasternode);
 
+    /// Refresh the lookups of an entry after its keys were updated in place
+    void UpdateIndexes(const CTxIn& vin);
+
     /// Find an entry in the masternode list that is next to be paid
     CMasternode* GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
 
@@ -135,9 +191,14 @@ public:
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
     CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
+    /// Drop cached scores and rankings, required whenever masternodes are added, removed or updated
+    void InvalidateRankings();
+
     void ProcessMasternodeConnections();
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+    /// Queue the signature of a received mnb or mnp for batch verification
+    void AddSignatureChecks(std::string& strCommand, CDataStream& vRecv, std::vector<CMasternodeSignatureCheck>& vChecks);
 
     /// Return the number of (unique) Masternodes
     int size() { return vMasternodes.size(); }
@@ -35,30 +35,11 @@ using namespace std;
 // PandemiaMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
-
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
+int64_t nLastStakeLatency = 0;
+static int64_t nTimeKernelFound = 0;
 
 // We want to sort transactions by priority and fee rate, so:
 typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
@@ -83,6 +64,430 @@ public:
     }
 };
 
+//
+// Unconfirmed transactions in the memory pool often depend on other
+// transactions in the memory pool. The pool keeps, for every transaction,
+// the size, fees and sigops of the package made of it and all its in-pool
+// ancestors, and orders transactions by that package fee rate. Once some
+// ancestors are in the block the rest of the package shrinks: CTxPackage
+// tracks these modified packages while the block is being assembled.
+//
+class CTxPackage
+{
+public:
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
+
+    CTxPackage() : nSizeWithAncestors(0), nModFeesWithAncestors(0), nSigOpCountWithAncestors(0) {}
+    CTxPackage(const CTxMemPoolEntry& entry) : nSizeWithAncestors(entry.GetSizeWithAncestors()),
+                                               nModFeesWithAncestors(entry.GetModFeesWithAncestors()),
+                                               nSigOpCountWithAncestors(entry.GetSigOpCountWithAncestors()) {}
+};
+
+// Fills a block template from the mempool: the priority area first, then ancestor packages by fee rate
+class CBlockAssembler
+{
+private:
+    CBlockTemplate* pblocktemplate;
+    CTxMemPool& pool;
+    const int nHeight;
+
+    // The coins as they are after the transactions already in the block
+    CCoinsViewCache view;
+
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockPrioritySize;
+    unsigned int nBlockMinSize;
+    bool fPrintPriority;
+
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+    std::set<uint256> setInBlock;
+
+    // Packages that lost ancestors to the block, with their own order
+    std::map<uint256, CTxPackage> mapModifiedTx;
+    std::set<CTxMemPoolAncestorScore> setModifiedByScore;
+
+    CTxMemPoolAncestorScore GetModifiedScore(const uint256& hash, const CTxPackage& package) const
+    {
+        const CTxMemPoolEntry& entry = pool.mapTx.find(hash)->second;
+        return CTxMemPoolAncestorScore(hash, entry.GetModifiedFee(), entry.GetTxSize(), package.nModFeesWithAncestors, package.nSizeWithAncestors);
+    }
+
+    void EraseModified(const uint256& hash)
+    {
+        std::map<uint256, CTxPackage>::iterator it = mapModifiedTx.find(hash);
+        if (it == mapModifiedTx.end())
+            return;
+        setModifiedByScore.erase(GetModifiedScore(hash, it->second));
+        mapModifiedTx.erase(it);
+    }
+
+    bool TestPackage(uint64_t nPackageSize, unsigned int nPackageSigOps) const
+    {
+        if (nBlockSize + nPackageSize >= nBlockMaxSize)
+            return false;
+        if (nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS)
+            return false;
+        return true;
+    }
+
+    void AddToBlock(const uint256& hash)
+    {
+        const CTxMemPoolEntry& entry = pool.mapTx.find(hash)->second;
+        pblocktemplate->block.vtx.push_back(entry.GetTx());
+        pblocktemplate->vTxFees.push_back(entry.GetFee());
+        pblocktemplate->vTxSigOps.push_back(entry.GetSigOpCount());
+        nBlockSize += entry.GetTxSize();
+        ++nBlockTx;
+        nBlockSigOps += entry.GetSigOpCount();
+        nFees += entry.GetFee();
+        setInBlock.insert(hash);
+        EraseModified(hash);
+
+        if (fPrintPriority) {
+            double dPriority = entry.GetPriority(nHeight);
+            CAmount nFeeDelta = 0;
+            pool.ApplyDeltas(hash, dPriority, nFeeDelta);
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                dPriority, CFeeRate(entry.GetModifiedFee(), entry.GetTxSize()).ToString(), hash.ToString());
+        }
+
+        // Whatever depends on this transaction has a smaller package left to include
+        std::set<uint256> setDescendants;
+        pool.CalculateDescendants(hash, setDescendants);
+        BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+            if (setInBlock.count(hashDescendant))
+                continue;
+            std::map<uint256, CTxPackage>::iterator it = mapModifiedTx.find(hashDescendant);
+            if (it == mapModifiedTx.end())
+                it = mapModifiedTx.insert(std::make_pair(hashDescendant, CTxPackage(pool.mapTx.find(hashDescendant)->second))).first;
+            else
+                setModifiedByScore.erase(GetModifiedScore(hashDescendant, it->second));
+            it->second.nSizeWithAncestors -= entry.GetTxSize();
+            it->second.nModFeesWithAncestors -= entry.GetModifiedFee();
+            it->second.nSigOpCountWithAncestors -= entry.GetSigOpCount();
+            setModifiedByScore.insert(GetModifiedScore(hashDescendant, it->second));
+        }
+    }
+
+    // The pool holds transactions that were valid when they arrived. Check that every
+    // transaction of a package, parents first, still connects to the block so far and
+    // passes its mandatory script checks; the signature cache makes this cheap for
+    // transactions checked on the way in.
+    bool TestPackageInputs(const std::vector<uint256>& vHashes)
+    {
+        CCoinsViewCache viewPackage(&view);
+        for (unsigned int i = 0; i < vHashes.size(); i++) {
+            const CTransaction& tx = pool.mapTx.find(vHashes[i])->second.GetTx();
+            CValidationState state;
+            if (!viewPackage.HaveInputs(tx) || !CheckInputs(tx, state, viewPackage, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
+                LogPrint("mempool", "CreateNewBlock(): skipping %s, inputs not valid on the tip\n", tx.GetHash().ToString());
+                return false;
+            }
+            CTxUndo txundo;
+            UpdateCoins(tx, state, viewPackage, txundo, nHeight);
+        }
+        viewPackage.Flush();
+        return true;
+    }
+
+    bool IsSelectable(const CTransaction& tx) const
+    {
+        return !tx.IsCoinBase() && !tx.IsCoinStake() && IsFinalTx(tx, nHeight);
+    }
+
+    bool HasParentsInBlock(const CTransaction& tx) const
+    {
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+            if (pool.mapTx.count(txin.prevout.hash) && !setInBlock.count(txin.prevout.hash))
+                return false;
+        }
+        return true;
+    }
+
+public:
+    CBlockAssembler(CBlockTemplate* pblocktemplateIn, CTxMemPool& poolIn, CCoinsView* pcoins, int nHeightIn) : pblocktemplate(pblocktemplateIn), pool(poolIn), nHeight(nHeightIn), view(pcoins)
+    {
+        // Largest block you're willing to create:
+        nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+        // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
+        nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SIZE - 1000), nBlockMaxSize));
+
+        // How much of the block should be dedicated to high-priority transactions,
+        // included regardless of the fees they pay
+        nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+        nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+
+        // Minimum block size you want to create; block will be filled with free transactions
+        // until there are no more or the block reaches this size:
+        nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+        nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+
+        fPrintPriority = GetBoolArg("-printpriority", false);
+
+        nBlockSize = 1000;
+        nBlockTx = 0;
+        nBlockSigOps = 100;
+        nFees = 0;
+    }
+
+    uint64_t GetBlockSize() const { return nBlockSize; }
+    uint64_t GetBlockTx() const { return nBlockTx; }
+    CAmount GetFees() const { return nFees; }
+
+    // Coin age priority does not follow the pool's order, this area still looks at every transaction
+    void AddPriorityTxs()
+    {
+        if (nBlockPrioritySize == 0)
+            return;
+
+        std::vector<TxPriority> vecPriority;
+        vecPriority.reserve(pool.mapTx.size());
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator mi = pool.mapTx.begin(); mi != pool.mapTx.end(); ++mi) {
+            double dPriority = mi->second.GetPriority(nHeight);
+            CAmount nFeeDelta = 0;
+            pool.ApplyDeltas(mi->first, dPriority, nFeeDelta);
+            vecPriority.push_back(TxPriority(dPriority, CFeeRate(mi->second.GetModifiedFee(), mi->second.GetTxSize()), &mi->second.GetTx()));
+        }
+
+        TxPriorityCompare comparer(false);
+        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+        // Transactions waiting for an in-pool parent to be added first
+        std::multimap<uint256, TxPriority> mapWaitPriority;
+        while (!vecPriority.empty()) {
+            TxPriority txPriority = vecPriority.front();
+            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            vecPriority.pop_back();
+
+            const CTransaction& tx = *txPriority.get<2>();
+            const uint256& hash = tx.GetHash();
+            const CTxMemPoolEntry& entry = pool.mapTx.find(hash)->second;
+
+            if (!HasParentsInBlock(tx)) {
+                BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+                    if (pool.mapTx.count(txin.prevout.hash) && !setInBlock.count(txin.prevout.hash)) {
+                        mapWaitPriority.insert(std::make_pair(txin.prevout.hash, txPriority));
+                        break;
+                    }
+                }
+                continue;
+            }
+
+            // Prioritise by fee once past the priority size or we run out of high-priority transactions
+            if (nBlockSize + entry.GetTxSize() >= nBlockPrioritySize || !AllowFree(txPriority.get<0>()))
+                break;
+
+            if (!TestPackage(entry.GetTxSize(), entry.GetSigOpCount()) || !IsSelectable(tx))
+                continue;
+            if (!TestPackageInputs(std::vector<uint256>(1, hash)))
+                continue;
+
+            AddToBlock(hash);
+
+            std::pair<std::multimap<uint256, TxPriority>::iterator, std::multimap<uint256, TxPriority>::iterator> range = mapWaitPriority.equal_range(hash);
+            for (std::multimap<uint256, TxPriority>::iterator it = range.first; it != range.second; ++it) {
+                vecPriority.push_back(it->second);
+                std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            }
+            mapWaitPriority.erase(range.first, range.second);
+        }
+    }
+
+    void AddPackageTxs()
+    {
+        // Packages that did not fit or cannot be mined yet
+        std::set<uint256> setFailed;
+        int nConsecutiveFailed = 0;
+
+        std::set<CTxMemPoolAncestorScore>::const_iterator mi = pool.setTxByAncestorScore.begin();
+        while (mi != pool.setTxByAncestorScore.end() || !setModifiedByScore.empty()) {
+            // A transaction with a modified package is taken from setModifiedByScore instead
+            if (mi != pool.setTxByAncestorScore.end() &&
+                (setInBlock.count(mi->hash) || mapModifiedTx.count(mi->hash) || setFailed.count(mi->hash))) {
+                ++mi;
+                continue;
+            }
+
+            uint256 hash;
+            CTxPackage package;
+            if (mi == pool.setTxByAncestorScore.end() ||
+                (!setModifiedByScore.empty() && *setModifiedByScore.begin() < *mi)) {
+                hash = setModifiedByScore.begin()->hash;
+                package = mapModifiedTx[hash];
+                EraseModified(hash);
+            } else {
+                hash = mi->hash;
+                package = CTxPackage(pool.mapTx.find(hash)->second);
+                ++mi;
+            }
+
+            // Everything left pays less, so stop once past the minimum size
+            if (package.nModFeesWithAncestors < ::minRelayTxFee.GetFee(package.nSizeWithAncestors) && nBlockSize >= nBlockMinSize)
+                break;
+
+            if (!TestPackage(package.nSizeWithAncestors, package.nSigOpCountWithAncestors)) {
+                setFailed.insert(hash);
+                // Give up once the block is close to full and nothing has fit for a while
+                if (++nConsecutiveFailed > 1000 && nBlockSize > nBlockMaxSize - 4000)
+                    break;
+                continue;
+            }
+
+            const CTxMemPoolEntry& entry = pool.mapTx.find(hash)->second;
+            std::set<uint256> setAncestors;
+            pool.CalculateAncestors(entry.GetTx(), setAncestors);
+            std::vector<std::pair<uint64_t, uint256> > vPackage;
+            vPackage.push_back(std::make_pair(entry.GetCountWithAncestors(), hash));
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+                if (!setInBlock.count(hashAncestor))
+                    vPackage.push_back(std::make_pair(pool.mapTx.find(hashAncestor)->second.GetCountWithAncestors(), hashAncestor));
+            }
+
+            bool fFinal = true;
+            for (unsigned int i = 0; i < vPackage.size() && fFinal; i++)
+                fFinal = IsSelectable(pool.mapTx.find(vPackage[i].second)->second.GetTx());
+            if (!fFinal) {
+                setFailed.insert(hash);
+                continue;
+            }
+
+            // A parent always has fewer ancestors than its children
+            std::sort(vPackage.begin(), vPackage.end());
+            std::vector<uint256> vHashes;
+            for (unsigned int i = 0; i < vPackage.size(); i++)
+                vHashes.push_back(vPackage[i].second);
+            if (!TestPackageInputs(vHashes)) {
+                setFailed.insert(hash);
+                continue;
+            }
+            nConsecutiveFailed = 0;
+
+            for (unsigned int i = 0; i < vHashes.size(); i++)
+                AddToBlock(vHashes[i]);
+        }
+    }
+};
+
+CAmount AddMempoolTransactions(CBlockTemplate* pblocktemplate, CTxMemPool& pool, CCoinsView* pcoins, int nHeight)
+{
+    AssertLockHeld(pool.cs);
+
+    CBlockAssembler assembler(pblocktemplate, pool, pcoins, nHeight);
+    assembler.AddPriorityTxs();
+    assembler.AddPackageTxs();
+
+    nLastBlockTx = assembler.GetBlockTx();
+    nLastBlockSize = assembler.GetBlockSize();
+    LogPrintf("CreateNewBlock(): total size %u\n", nLastBlockSize);
+
+    return assembler.GetFees();
+}
+
+//
+// The coinbase and mempool transactions of the next proof-of-stake block,
+// assembled before each kernel search and only rebuilt when the tip or the
+// mempool changed. A found coinstake is spliced in, so the block can be
+// signed and broadcast without assembling it first.
+//
+class CStakeTemplateCache
+{
+private:
+    CCriticalSection cs;
+    unique_ptr<CBlockTemplate> ptemplate;
+    uint256 hashPrevBlock;
+    unsigned int nTransactionsUpdated;
+    // Outputs spent by the cached transactions, which the coinstake must leave alone
+    std::set<COutPoint> setSpent;
+
+public:
+    CStakeTemplateCache() : hashPrevBlock(0), nTransactionsUpdated(0) {}
+
+    void Refresh()
+    {
+        LOCK(cs);
+        LOCK2(cs_main, mempool.cs);
+        CBlockIndex* pindexPrev = chainActive.Tip();
+        if (ptemplate.get() && hashPrevBlock == pindexPrev->GetBlockHash() && nTransactionsUpdated == mempool.GetTransactionsUpdated())
+            return;
+
+        int64_t nTimeStart = GetTimeMicros();
+        const int nHeight = pindexPrev->nHeight + 1;
+        unique_ptr<CBlockTemplate> pnew(new CBlockTemplate());
+
+        // The stake reward and masternode payment go in the coinstake, the coinbase stays empty
+        CMutableTransaction txCoinbase;
+        txCoinbase.vin.resize(1);
+        txCoinbase.vin[0].prevout.SetNull();
+        txCoinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+        txCoinbase.vout.resize(1);
+        txCoinbase.vout[0].SetEmpty();
+        pnew->block.vtx.push_back(txCoinbase);
+        pnew->vTxFees.push_back(-1);
+        pnew->vTxSigOps.push_back(GetLegacySigOpCount(pnew->block.vtx[0]));
+
+        AddMempoolTransactions(pnew.get(), mempool, pcoinsTip, nHeight);
+
+        setSpent.clear();
+        for (unsigned int i = 1; i < pnew->block.vtx.size(); i++) {
+            BOOST_FOREACH (const CTxIn& txin, pnew->block.vtx[i].vin)
+                setSpent.insert(txin.prevout);
+        }
+        ptemplate.swap(pnew);
+        hashPrevBlock = pindexPrev->GetBlockHash();
+        nTransactionsUpdated = mempool.GetTransactionsUpdated();
+        LogPrint("staking", "Stake template for height %d rebuilt with %u transactions in %.2fms\n",
+            nHeight, ptemplate->block.vtx.size(), (GetTimeMicros() - nTimeStart) * 0.001);
+    }
+
+    /**
+     * Copy the cached transactions into blocktemplate, with the coinstake, if they were built on
+     * pindexPrev and it is still the tip. The cached transactions were checked against that tip when
+     * the template was built, so only the coinstake is checked here: its inputs and scripts, that
+     * no cached transaction spends the same outputs, and that the block stays within its limits.
+     */
+    bool Splice(CBlockTemplate& blocktemplate, const CTransaction& txCoinStake, const CBlockIndex* pindexPrev)
+    {
+        LOCK2(cs, cs_main);
+        if (!ptemplate.get() || hashPrevBlock != pindexPrev->GetBlockHash() || chainActive.Tip() != pindexPrev)
+            return false;
+
+        CCoinsViewCache view(pcoinsTip);
+        CValidationState state;
+        if (!CheckInputs(txCoinStake, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+            return error("%s : coinstake %s does not connect to the tip", __func__, txCoinStake.GetHash().ToString());
+        BOOST_FOREACH (const CTxIn& txin, txCoinStake.vin) {
+            if (setSpent.count(txin.prevout)) {
+                LogPrint("staking", "%s : coinstake %s conflicts with the cached transactions\n", __func__, txCoinStake.GetHash().ToString());
+                return false;
+            }
+        }
+
+        blocktemplate.block.vtx = ptemplate->block.vtx;
+        blocktemplate.vTxFees = ptemplate->vTxFees;
+        blocktemplate.vTxSigOps = ptemplate->vTxSigOps;
+        blocktemplate.block.vtx.insert(blocktemplate.block.vtx.begin() + 1, txCoinStake);
+        blocktemplate.vTxFees.insert(blocktemplate.vTxFees.begin() + 1, 0);
+        blocktemplate.vTxSigOps.insert(blocktemplate.vTxSigOps.begin() + 1, GetLegacySigOpCount(txCoinStake) + GetP2SHSigOpCount(txCoinStake, view));
+
+        unsigned int nSigOps = 0;
+        for (unsigned int i = 0; i < blocktemplate.vTxSigOps.size(); i++)
+            nSigOps += blocktemplate.vTxSigOps[i];
+        // The assembler's own size cap, which leaves room for the block signature
+        if (nSigOps > MAX_BLOCK_SIGOPS || ::GetSerializeSize(blocktemplate.block, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE - 1000) {
+            LogPrint("staking", "%s : block with coinstake %s is over the size or sigop limit\n", __func__, txCoinStake.GetHash().ToString());
+            return false;
+        }
+        return true;
+    }
+};
+
+static CStakeTemplateCache stakeTemplateCache;
+
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -128,6 +533,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
     if (fProofOfStake) {
         boost::this_thread::interruption_point();
+        stakeTemplateCache.Refresh();
         pblock->nTime = GetAdjustedTime();
         CBlockIndex* pindexPrev = chainActive.Tip();
         pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
@@ -137,6 +543,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         if (nSearchTime >= nLastCoinStakeSearchTime) {
             unsigned int nTxNewTime = 0;
             if (pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake, nTxNewTime)) {
+                nTimeKernelFound = GetTimeMicros();
                 pblock->nTime = nTxNewTime;
                 pblock->vtx[0].vout[0].SetEmpty();
                 pblock->vtx.push_back(CTransaction(txCoinStake));
@@ -148,22 +555,15 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
         if (!fStakeFound)
             return NULL;
-    }
-
-    // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
-    nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SIZE - 1000), nBlockMaxSize));
 
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-    // Minimum block size you want to create; block will be filled with free transactions
-    // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+        // The kernel was searched against pindexPrev, fall back to a full assembly if the tip moved
+        // meanwhile or the coinstake does not fit the cached transactions
+        if (pindexPrev == chainActive.Tip() && stakeTemplateCache.Splice(*pblocktemplate, CTransaction(txCoinStake), pindexPrev)) {
+            pblock->hashPrevBlock = pindexPrev->GetBlockHash();
+            pblock->nNonce = 0;
+            return pblocktemplate.release();
+        }
+    }
 
     // Collect memory pool transactions into the block
     CAmount nFees = 0;
@@ -173,178 +573,21 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-                continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
 
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        vector<CBigNum> vBlockSerials;
-        vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
+        // The coinstake spends its inputs before any mempool transaction in the block can
+        CCoinsViewCache viewBlock(pcoinsTip);
+        if (fProofOfStake) {
             CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
-
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            for (const CBigNum bnSerial : vTxSerials)
-                vBlockSerials.emplace_back(bnSerial);
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
+            if (!CheckInputs(pblock->vtx[1], state, viewBlock, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
+                LogPrintf("CreateNewBlock() : coinstake %s does not connect to the tip\n", pblock->vtx[1].GetHash().ToString());
+                return NULL;
             }
+            CTxUndo txundo;
+            UpdateCoins(pblock->vtx[1], state, viewBlock, txundo, nHeight);
         }
 
+        nFees = AddMempoolTransactions(pblocktemplate.get(), mempool, &viewBlock, nHeight);
+
         if (!fProofOfStake) {
             //Masternode and general budget payments
             FillBlockPayee(txNew, nFees, fProofOfStake);
@@ -355,10 +598,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
             }
         }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u\n", nBlockSize);
-
         // Compute final coinbase transaction.
         pblock->vtx[0].vin[0].scriptSig = CScript() << nHeight << OP_0;
         if (!fProofOfStake) {
@@ -525,7 +764,8 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
                 continue;
             }
 
-            LogPrintf("CPUMiner : proof-of-stake block was signed %s \n", pblock->GetHash().ToString().c_str());
+            nLastStakeLatency = GetTimeMicros() - nTimeKernelFound;
+            LogPrintf("CPUMiner : proof-of-stake block was signed %s, %.2fms after the kernel was found \n", pblock->GetHash().ToString().c_str(), nLastStakeLatency * 0.001);
             SetThreadPriority(THREAD_PRIORITY_NORMAL);
             ProcessBlockFound(pblock, *pwallet, reservekey);
             SetThreadPriority(THREAD_PRIORITY_LOWEST);
@@ -6,13 +6,17 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "amount.h"
+
 #include <stdint.h>
 
 class CBlock;
 class CBlockHeader;
 class CBlockIndex;
+class CCoinsView;
 class CReserveKey;
 class CScript;
+class CTxMemPool;
 class CWallet;
 
 struct CBlockTemplate;
@@ -21,6 +25,12 @@ struct CBlockTemplate;
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake);
+/**
+ * Add mempool transactions to a block template, best ancestor package fee rate first. Packages whose
+ * inputs do not connect to pcoins, or fail their script checks, are left out. Requires pool.cs, and
+ * cs_main when pcoins is pcoinsTip. Returns the fees collected.
+ */
+CAmount AddMempoolTransactions(CBlockTemplate* pblocktemplate, CTxMemPool& pool, CCoinsView* pcoins, int nHeight);
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
@@ -13,9 +13,23 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+// GetHash() hashes nVersion through nNonce in place: they must be laid out back to back, exactly as serialized
+static_assert(std::is_standard_layout<CBlockHeader>::value, "CBlockHeader field offsets are needed");
+static_assert(offsetof(CBlockHeader, nNonce) + sizeof(uint32_t) - offsetof(CBlockHeader, nVersion) == sizeof(CBlockHeader::vchHashedHeader),
+    "CBlockHeader fields must match the 80-byte serialized header");
+
 uint256 CBlockHeader::GetHash() const
 {
-    return HashQuark(BEGIN(nVersion), END(nNonce));
+    if (!fHashCached || memcmp(vchHashedHeader, BEGIN(nVersion), sizeof(vchHashedHeader)) != 0) {
+        hashCached = HashQuark(BEGIN(nVersion), END(nNonce));
+        memcpy(vchHashedHeader, BEGIN(nVersion), sizeof(vchHashedHeader));
+        fHashCached = true;
+    }
+    return hashCached;
 }
 
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
@@ -63,15 +77,18 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     bool mutated = false;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // Sibling nodes are adjacent in vMerkleTree, so every full pair is one
+        // 64-byte input, and the whole level is hashed in a single batch.
+        size_t nLevel = vMerkleTree.size();
+        vMerkleTree.resize(nLevel + (nSize + 1) / 2);
+        SHA256D64(vMerkleTree[nLevel].begin(), vMerkleTree[j].begin(), nSize / 2);
+        if (nSize % 2 == 1) {
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree.back() = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
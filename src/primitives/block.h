@@ -22,6 +22,10 @@ static const unsigned int MAX_BLOCK_SIZE = 2000000;
  * to everyone and the block is added to the block chain.  The first transaction
  * in the block is a special one that creates a new coin owned by the creator
  * of the block.
+ *
+ * Not thread safe: GetHash() writes a hash cache inside the object, so even
+ * const access to a header shared between threads must hold the lock that
+ * guards it, as writing its fields does.
  */
 class CBlockHeader
 {
@@ -35,6 +39,11 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
+    // memory only: the hashed header bytes and their hash, see GetHash()
+    mutable unsigned char vchHashedHeader[80];
+    mutable uint256 hashCached;
+    mutable bool fHashCached;
+
     CBlockHeader()
     {
         SetNull();
@@ -61,6 +70,7 @@ public:
         nTime = 0;
         nBits = 0;
         nNonce = 0;
+        fHashCached = false;
     }
 
     bool IsNull() const
@@ -68,6 +78,12 @@ public:
         return (nBits == 0);
     }
 
+    /**
+     * Quark hash of the header. The result is cached along with the header bytes it
+     * was computed from, so repeated calls cost a comparison, and a header whose
+     * fields were changed since (like a block template being mined) is hashed again.
+     * Filling the cache makes this a write: see the class comment on threads.
+     */
     uint256 GetHash() const;
 
     int64_t GetBlockTime() const
@@ -122,14 +138,8 @@ public:
 
     CBlockHeader GetBlockHeader() const
     {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        block.hashPrevBlock  = hashPrevBlock;
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.nTime          = nTime;
-        block.nBits          = nBits;
-        block.nNonce         = nNonce;
-        return block;
+        // Copying the base keeps the cached hash
+        return *this;
     }
 
     // ppcoin: two types of block: proof-of-work or proof-of-stake
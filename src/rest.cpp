@@ -3,21 +3,31 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "coins.h"
 #include "main.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "rpcserver.h"
 #include "streams.h"
 #include "sync.h"
+#include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/dynamic_bitset.hpp>
 
 #include <univalue.h>
 
 using namespace std;
 
+//! Most headers a single /rest/headers/ request returns
+static const size_t MAX_REST_HEADERS_RESULTS = 2000;
+//! Most outpoints a single /rest/getutxos request may query
+static const size_t MAX_GETUTXOS_OUTPOINTS = 15;
+//! Size of the chunks large responses are streamed in
+static const size_t REST_CHUNK_SIZE = 64 * 1024;
+
 enum RetFormat {
     RF_UNDEF,
     RF_BINARY,
@@ -42,8 +52,68 @@ public:
     string message;
 };
 
+/** An unspent output as returned by /rest/getutxos */
+struct CRESTCoin {
+    uint32_t nHeight;
+    CTxOut out;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        // Transaction versions are no longer kept with the coins, the field stays for compatibility
+        uint32_t nTxVerDummy = 0;
+        READWRITE(nTxVerDummy);
+        READWRITE(nHeight);
+        READWRITE(out);
+    }
+};
+
+/**
+ * Writes a response body with HTTP/1.1 chunked transfer encoding, so that a large
+ * response goes out while it is being produced instead of being built in memory first.
+ */
+class CRESTChunkedWriter
+{
+private:
+    std::ostream& stream;
+    std::string strBuffer;
+
+    void WriteChunk()
+    {
+        if (strBuffer.empty())
+            return;
+        stream << strprintf("%x\r\n", strBuffer.size()) << strBuffer << "\r\n";
+        strBuffer.clear();
+    }
+
+public:
+    CRESTChunkedWriter(std::ostream& streamIn, bool fRun, const char* contentType) : stream(streamIn)
+    {
+        stream << HTTPReplyHeaderChunked(HTTP_OK, fRun, contentType);
+        strBuffer.reserve(REST_CHUNK_SIZE);
+    }
+
+    void Write(const std::string& str)
+    {
+        strBuffer.append(str);
+        if (strBuffer.size() >= REST_CHUNK_SIZE)
+            WriteChunk();
+    }
+
+    void Finish()
+    {
+        WriteChunk();
+        stream << "0\r\n\r\n" << std::flush;
+    }
+};
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern UniValue blockHeaderToJSON(const CBlockHeader& block, const CBlockIndex* blockindex);
+extern UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e);
+extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -90,6 +160,78 @@ static bool ParseHashStr(const string& strReq, uint256& v)
     return true;
 }
 
+static bool rest_headers(AcceptedConnection* conn,
+    string& strReq,
+    const string& strBody,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        throw RESTERR(HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
+
+    long count = strtol(path[0].c_str(), NULL, 10);
+    if (count < 1 || count > (long)MAX_REST_HEADERS_RESULTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Header count out of range: %s", path[0]));
+
+    string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    // Collect the block indexes under the lock, serialize them after releasing it
+    std::vector<const CBlockIndex*> headers;
+    headers.reserve(count);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        const CBlockIndex* pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
+        while (pindex != NULL && chainActive.Contains(pindex)) {
+            headers.push_back(pindex);
+            if (headers.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CRESTChunkedWriter writer(conn->stream(), fRun, rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+        BOOST_FOREACH (const CBlockIndex* pindex, headers) {
+            CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+            ssHeader << pindex->GetBlockHeader();
+            writer.Write(rf == RF_BINARY ? ssHeader.str() : HexStr(ssHeader.begin(), ssHeader.end()));
+        }
+        if (rf == RF_HEX)
+            writer.Write("\n");
+        writer.Finish();
+        return true;
+    }
+
+    case RF_JSON: {
+        CRESTChunkedWriter writer(conn->stream(), fRun, "application/json");
+        writer.Write("[");
+        for (unsigned int i = 0; i < headers.size(); i++)
+            writer.Write((i > 0 ? "," : "") + blockHeaderToJSON(headers[i]->GetBlockHeader(), headers[i]).write());
+        writer.Write("]\n");
+        writer.Finish();
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_block(AcceptedConnection* conn,
     string& strReq,
     map<string, string>& mapHeaders,
@@ -150,6 +292,7 @@ static bool rest_block(AcceptedConnection* conn,
 
 static bool rest_block_extended(AcceptedConnection* conn,
     string& strReq,
+    const string& strBody,
     map<string, string>& mapHeaders,
     bool fRun)
 {
@@ -158,14 +301,123 @@ static bool rest_block_extended(AcceptedConnection* conn,
 
 static bool rest_block_notxdetails(AcceptedConnection* conn,
     string& strReq,
+    const string& strBody,
     map<string, string>& mapHeaders,
     bool fRun)
 {
     return rest_block(conn, strReq, mapHeaders, fRun, false);
 }
 
+static bool rest_chaininfo(AcceptedConnection* conn,
+    string& strReq,
+    const string& strBody,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue rpcParams(UniValue::VARR);
+        UniValue chainInfoObject;
+        {
+            LOCK(cs_main);
+            chainInfoObject = getblockchaininfo(rpcParams, false);
+        }
+        string strJSON = chainInfoObject.write() + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_mempool_info(AcceptedConnection* conn,
+    string& strReq,
+    const string& strBody,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue mempoolInfoObject = getmempoolinfo(UniValue(UniValue::VARR), false);
+        string strJSON = mempoolInfoObject.write() + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_mempool_contents(AcceptedConnection* conn,
+    string& strReq,
+    const string& strBody,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    if (rf == RF_UNDEF)
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    // Copy what is sent under the lock and stream it afterwards, so that a slow client
+    // does not hold up block and transaction processing. The JSON fields are filled in
+    // under the lock, which keeps the "depends" lists consistent with each other.
+    std::vector<CTransaction> vtx;
+    std::vector<std::pair<uint256, UniValue> > vEntries;
+    {
+        LOCK2(cs_main, mempool.cs);
+        if (rf == RF_JSON)
+            vEntries.reserve(mempool.mapTx.size());
+        else
+            vtx.reserve(mempool.mapTx.size());
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+            if (rf == RF_JSON)
+                vEntries.push_back(std::make_pair(it->first, mempoolEntryToJSON(it->second)));
+            else
+                vtx.push_back(it->second.GetTx());
+        }
+    }
+
+    // The binary and hex formats are the serialized transactions back to back
+    CRESTChunkedWriter writer(conn->stream(), fRun, rf == RF_BINARY ? "application/octet-stream" : rf == RF_HEX ? "text/plain" : "application/json");
+    if (rf == RF_JSON) {
+        writer.Write("{");
+        for (unsigned int i = 0; i < vEntries.size(); i++)
+            writer.Write((i ? ",\"" : "\"") + vEntries[i].first.ToString() + "\":" + vEntries[i].second.write());
+    }
+    for (unsigned int i = 0; i < vtx.size(); i++) {
+        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+        ssTx << vtx[i];
+        writer.Write(rf == RF_BINARY ? ssTx.str() : HexStr(ssTx.begin(), ssTx.end()));
+    }
+    if (rf == RF_JSON)
+        writer.Write("}");
+    if (rf != RF_BINARY)
+        writer.Write("\n");
+    writer.Finish();
+    return true;
+}
+
 static bool rest_tx(AcceptedConnection* conn,
     string& strReq,
+    const string& strBody,
     map<string, string>& mapHeaders,
     bool fRun)
 {
@@ -215,20 +467,200 @@ static bool rest_tx(AcceptedConnection* conn,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_getutxos(AcceptedConnection* conn,
+    string& strReq,
+    const string& strBody,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    vector<string> uriParts;
+    if (params.size() > 0 && params[0].length() > 1) {
+        std::string strUriParams = params[0].substr(1);
+        boost::split(uriParts, strUriParams, boost::is_any_of("/"));
+    }
+
+    // throw exception in case of an empty request
+    if (strBody.empty() && uriParts.empty())
+        throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+
+    bool fInputParsed = false;
+    bool fCheckMemPool = false;
+    vector<COutPoint> vOutPoints;
+
+    // parse/deserialize input
+    // input-format = output-format, rest/getutxos/bin requires binary input, gives binary output, ...
+    if (uriParts.size() > 0) {
+        // inputs are sent over the URI scheme (/rest/getutxos/checkmempool/txid1-n/txid2-n/...)
+        if (uriParts[0] == "checkmempool")
+            fCheckMemPool = true;
+
+        for (size_t i = (fCheckMemPool) ? 1 : 0; i < uriParts.size(); i++) {
+            uint256 txid;
+            int32_t nOutput;
+            std::string strTxid = uriParts[i].substr(0, uriParts[i].find("-"));
+            std::string strOutput = uriParts[i].substr(uriParts[i].find("-") + 1);
+
+            if (!ParseInt32(strOutput, &nOutput) || nOutput < 0 || !IsHex(strTxid))
+                throw RESTERR(HTTP_BAD_REQUEST, "Parse error");
+
+            txid.SetHex(strTxid);
+            vOutPoints.push_back(COutPoint(txid, (uint32_t)nOutput));
+        }
+
+        if (vOutPoints.size() > 0)
+            fInputParsed = true;
+        else
+            throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+    }
+
+    switch (rf) {
+    case RF_HEX:
+    case RF_BINARY: {
+        // deserialize only if the body holds data, the URI scheme may have been used instead
+        std::vector<unsigned char> vBody = rf == RF_HEX ? ParseHex(strBody) : std::vector<unsigned char>(strBody.begin(), strBody.end());
+        if (!vBody.empty()) {
+            if (fInputParsed) // don't allow sending input over URI and HTTP body
+                throw RESTERR(HTTP_BAD_REQUEST, "Combination of URI scheme inputs and raw post data is not allowed");
+
+            try {
+                CDataStream oss(vBody, SER_NETWORK, PROTOCOL_VERSION);
+                oss >> fCheckMemPool;
+                oss >> vOutPoints;
+            } catch (const std::ios_base::failure& e) {
+                // abort in case of unreadable binary data
+                throw RESTERR(HTTP_BAD_REQUEST, "Parse error");
+            }
+        }
+        break;
+    }
+
+    case RF_JSON: {
+        if (!fInputParsed)
+            throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+        break;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // limit max outpoints
+    if (vOutPoints.size() > MAX_GETUTXOS_OUTPOINTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_GETUTXOS_OUTPOINTS, vOutPoints.size()));
+
+    // check spentness and form a bitmap (as well as a JSON capable human-readable string representation)
+    vector<unsigned char> bitmap;
+    vector<CRESTCoin> outs;
+    std::string bitmapStringRepresentation;
+    boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
+    int nHeight;
+    uint256 hashTip;
+    {
+        LOCK2(cs_main, mempool.cs);
+
+        // Outputs are looked up one by one, there is no need to bring whole transactions in
+        CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
+        CCoinsView& view = fCheckMemPool ? static_cast<CCoinsView&>(viewMempool) : static_cast<CCoinsView&>(*pcoinsTip);
+
+        for (size_t i = 0; i < vOutPoints.size(); i++) {
+            Coin coin;
+            bool hit = false;
+            if (view.GetCoin(vOutPoints[i], coin) && !coin.IsSpent() && !(fCheckMemPool && mempool.isSpent(vOutPoints[i]))) {
+                hit = true;
+                CRESTCoin restCoin;
+                restCoin.nHeight = coin.nHeight;
+                restCoin.out = coin.out;
+                outs.push_back(restCoin);
+            }
+
+            hits[i] = hit;
+            bitmapStringRepresentation.append(hit ? "1" : "0"); // form a binary string representation (human-readable for json output)
+        }
+        nHeight = chainActive.Height();
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    boost::to_block_range(hits, std::back_inserter(bitmap));
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        // serialize data
+        // use exact same output as mentioned in Bip64
+        CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetUTXOResponse << nHeight << hashTip << bitmap << outs;
+        if (rf == RF_BINARY) {
+            string ssGetUTXOResponseString = ssGetUTXOResponse.str();
+            conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, ssGetUTXOResponseString.size(), "application/octet-stream") << ssGetUTXOResponseString << std::flush;
+        } else {
+            string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
+            conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue objGetUTXOResponse(UniValue::VOBJ);
+
+        // pack in some essentials
+        // use more or less the same output as mentioned in Bip64
+        objGetUTXOResponse.push_back(Pair("chainHeight", nHeight));
+        objGetUTXOResponse.push_back(Pair("chaintipHash", hashTip.GetHex()));
+        objGetUTXOResponse.push_back(Pair("bitmap", bitmapStringRepresentation));
+
+        UniValue utxos(UniValue::VARR);
+        BOOST_FOREACH (const CRESTCoin& coin, outs) {
+            UniValue utxo(UniValue::VOBJ);
+            utxo.push_back(Pair("height", (int32_t)coin.nHeight));
+            utxo.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
+
+            // include the script in a json output
+            UniValue o(UniValue::VOBJ);
+            ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
+            utxo.push_back(Pair("scriptPubKey", o));
+            utxos.push_back(utxo);
+        }
+        objGetUTXOResponse.push_back(Pair("utxos", utxos));
+
+        // return json string
+        string strJSON = objGetUTXOResponse.write() + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(AcceptedConnection* conn,
         string& strURI,
+        const string& strBody,
         map<string, string>& mapHeaders,
         bool fRun);
 } uri_prefixes[] = {
     {"/rest/tx/", rest_tx},
     {"/rest/block/notxdetails/", rest_block_notxdetails},
     {"/rest/block/", rest_block_extended},
+    {"/rest/chaininfo", rest_chaininfo},
+    {"/rest/mempool/info", rest_mempool_info},
+    {"/rest/mempool/contents", rest_mempool_contents},
+    {"/rest/headers/", rest_headers},
+    {"/rest/getutxos", rest_getutxos},
 };
 
 bool HTTPReq_REST(AcceptedConnection* conn,
     string& strURI,
+    const string& strBody,
     map<string, string>& mapHeaders,
     bool fRun)
 {
@@ -241,7 +673,7 @@ bool HTTPReq_REST(AcceptedConnection* conn,
             unsigned int plen = strlen(uri_prefixes[i].prefix);
             if (strURI.substr(0, plen) == uri_prefixes[i].prefix) {
                 string strReq = strURI.substr(plen);
-                return uri_prefixes[i].handler(conn, strReq, mapHeaders, fRun);
+                return uri_prefixes[i].handler(conn, strReq, strBody, mapHeaders, fRun);
             }
         }
     } catch (RestErr& re) {
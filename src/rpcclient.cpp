@@ -119,7 +119,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"setstakesplitthreshold", 0},
         {"autocombinerewards", 0},
         {"autocombinerewards", 1},
-        {"getfeeinfo", 0}
+        {"getfeeinfo", 0},
+        {"getaddressbalance", 0},
+        {"getaddresstxids", 0},
+        {"getaddressutxos", 0},
+        {"getspentinfo", 0}
     };
 
 class CRPCConvertTable
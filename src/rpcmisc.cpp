@@ -501,6 +501,7 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if masternode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"stakelatency\": n,                (numeric) microseconds from finding the kernel of the last staked block to submitting it, 0 if none\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getstakingstatus", "") + HelpExampleRpc("getstakingstatus", ""));
@@ -521,7 +522,222 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
     else if (mapHashedBlocks.count(chainActive.Tip()->nHeight - 1) && nLastCoinStakeSearchInterval)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
+    obj.push_back(Pair("stakelatency", nLastStakeLatency));
 
     return obj;
 }
 #endif // ENABLE_WALLET
+
+/** Addresses named by the first parameter, either a single address or {"addresses": [...]} */
+static void ParseAddressIndexParams(const UniValue& params, std::vector<std::pair<unsigned char, uint160> >& addresses)
+{
+    std::vector<std::string> vstrAddresses;
+    if (params[0].isStr()) {
+        vstrAddresses.push_back(params[0].get_str());
+    } else if (params[0].isObject()) {
+        const UniValue& array = find_value(params[0].get_obj(), "addresses");
+        if (!array.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        for (unsigned int i = 0; i < array.size(); i++)
+            vstrAddresses.push_back(array[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    BOOST_FOREACH (const std::string& strAddress, vstrAddresses) {
+        unsigned char type;
+        uint160 hashBytes;
+        if (!GetAddressIndexKey(CBitcoinAddress(strAddress).Get(), type, hashBytes))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + strAddress);
+        addresses.push_back(std::make_pair(type, hashBytes));
+    }
+}
+
+/** Optional height range of the first parameter, 0 meaning unbounded */
+static void ParseHeightRange(const UniValue& params, int& nStart, int& nEnd)
+{
+    nStart = nEnd = 0;
+    if (!params[0].isObject())
+        return;
+    const UniValue& start = find_value(params[0].get_obj(), "start");
+    const UniValue& end = find_value(params[0].get_obj(), "end");
+    if (start.isNum())
+        nStart = start.get_int();
+    if (end.isNum())
+        nEnd = end.get_int();
+    if (nStart < 0 || nEnd < 0 || (nEnd > 0 && nEnd < nStart))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"pndmaddress\"|{\"addresses\": [\"pndmaddress\",...]}\n"
+            "\nReturns the balance of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"pndmaddress\"     (string, required) The pndm address, or an object with an array of addresses\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : x.xxx,    (numeric) The current balance in PNDM\n"
+            "  \"received\" : x.xxx,   (numeric) The total amount received in PNDM, including change\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"pF4JLTp3Q2YBPpJxzxFNZiFfTCtRvqCc3d\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"pF4JLTp3Q2YBPpJxzxFNZiFfTCtRvqCc3d\"]}"));
+
+    std::vector<std::pair<unsigned char, uint160> > addresses;
+    ParseAddressIndexParams(params, addresses);
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (std::vector<std::pair<unsigned char, uint160> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itIndex = addressIndex.begin(); itIndex != addressIndex.end(); itIndex++) {
+            if (itIndex->second > 0)
+                nReceived += itIndex->second;
+            nBalance += itIndex->second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids \"pndmaddress\"|{\"addresses\": [\"pndmaddress\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the txids of the transactions involving one or more addresses, in chain order (requires -addressindex).\n"
+            "Large histories can be paged through with the height range.\n"
+            "\nArguments:\n"
+            "1. \"pndmaddress\"     (string, required) The pndm address, or an object with:\n"
+            "    \"addresses\"      (array, required) The pndm addresses\n"
+            "    \"start\"          (numeric, optional) The first block height to include\n"
+            "    \"end\"            (numeric, optional) The last block height to include\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"pF4JLTp3Q2YBPpJxzxFNZiFfTCtRvqCc3d\"], \"start\": 1000, \"end\": 2000}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"pF4JLTp3Q2YBPpJxzxFNZiFfTCtRvqCc3d\"], \"start\": 1000, \"end\": 2000}"));
+
+    std::vector<std::pair<unsigned char, uint160> > addresses;
+    ParseAddressIndexParams(params, addresses);
+    int nStart, nEnd;
+    ParseHeightRange(params, nStart, nEnd);
+
+    // Entries of several addresses are merged by position in the chain
+    std::set<std::pair<std::pair<int, unsigned int>, uint256> > setTxids;
+    for (std::vector<std::pair<unsigned char, uint160> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itIndex = addressIndex.begin(); itIndex != addressIndex.end(); itIndex++)
+            setTxids.insert(std::make_pair(std::make_pair(itIndex->first.blockHeight, itIndex->first.txindex), itIndex->first.txhash));
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::set<std::pair<std::pair<int, unsigned int>, uint256> >::const_iterator it = setTxids.begin(); it != setTxids.end(); it++)
+        result.push_back(it->second.GetHex());
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"pndmaddress\"|{\"addresses\": [\"pndmaddress\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the unspent outputs of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"pndmaddress\"     (string, required) The pndm address, or an object with:\n"
+            "    \"addresses\"      (array, required) The pndm addresses\n"
+            "    \"start\"          (numeric, optional) Only outputs created at this height or later\n"
+            "    \"end\"            (numeric, optional) Only outputs created at this height or earlier\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"pndmaddress\",  (string) The address\n"
+            "    \"txid\" : \"transactionid\",   (string) The transaction id\n"
+            "    \"outputIndex\" : n,           (numeric) The output index\n"
+            "    \"script\" : \"hex\",            (string) The output script\n"
+            "    \"amount\" : x.xxx,            (numeric) The output value in PNDM\n"
+            "    \"height\" : n                 (numeric) The height of the block that created the output\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"pF4JLTp3Q2YBPpJxzxFNZiFfTCtRvqCc3d\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"pF4JLTp3Q2YBPpJxzxFNZiFfTCtRvqCc3d\"]}"));
+
+    std::vector<std::pair<unsigned char, uint160> > addresses;
+    ParseAddressIndexParams(params, addresses);
+    int nStart, nEnd;
+    ParseHeightRange(params, nStart, nEnd);
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<unsigned char, uint160> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+        if (!GetAddressUnspent(it->first, it->second, unspentOutputs))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+        std::string strAddress = CBitcoinAddress(GetAddressIndexDestination(it->first, it->second)).ToString();
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itOut = unspentOutputs.begin(); itOut != unspentOutputs.end(); itOut++) {
+            if (itOut->second.blockHeight < nStart || (nEnd > 0 && itOut->second.blockHeight > nEnd))
+                continue;
+            UniValue output(UniValue::VOBJ);
+            output.push_back(Pair("address", strAddress));
+            output.push_back(Pair("txid", itOut->first.txhash.GetHex()));
+            output.push_back(Pair("outputIndex", (int)itOut->first.index));
+            output.push_back(Pair("script", HexStr(itOut->second.script.begin(), itOut->second.script.end())));
+            output.push_back(Pair("amount", ValueFromAmount(itOut->second.satoshis)));
+            output.push_back(Pair("height", itOut->second.blockHeight));
+            result.push_back(output);
+        }
+    }
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\": \"transactionid\", \"index\": n}\n"
+            "\nReturns the input that spent an output (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "    \"txid\"           (string, required) The transaction id of the output\n"
+            "    \"index\"          (numeric, required) The output index\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"transactionid\",   (string) The spending transaction id\n"
+            "  \"index\" : n,                 (numeric) The spending input index\n"
+            "  \"height\" : n                 (numeric) The height of the block with the spending transaction\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    const UniValue& txid = find_value(params[0].get_obj(), "txid");
+    const UniValue& index = find_value(params[0].get_obj(), "index");
+    if (!txid.isStr() || !index.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    CSpentIndexKey key(ParseHashV(txid, "txid"), index.get_int());
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.inputIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    return result;
+}
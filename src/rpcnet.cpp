@@ -346,6 +346,45 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getmessagestats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getmessagestats\n"
+            "\nReturns per-command statistics of received message processing.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"commands\": {\n"
+            "    \"command\": {            (string) The message command\n"
+            "      \"processed\": n,       (numeric) Messages processed\n"
+            "      \"totaltime\": n,       (numeric) Total processing time in microseconds\n"
+            "      \"avgtime\": n,         (numeric) Average processing time in microseconds\n"
+            "      \"maxtime\": n          (numeric) Longest processing time in microseconds\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmessagestats", "") + HelpExampleRpc("getmessagestats", ""));
+
+    std::map<std::string, CMessageStats> mapStats;
+    GetMessageStats(mapStats);
+
+    UniValue commands(UniValue::VOBJ);
+    for (std::map<std::string, CMessageStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CMessageStats& stats = it->second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("totaltime", stats.nTimeTotal));
+        obj.push_back(Pair("avgtime", stats.nProcessed ? stats.nTimeTotal / (int64_t)stats.nProcessed : 0));
+        obj.push_back(Pair("maxtime", stats.nTimeMax));
+        commands.push_back(Pair(SanitizeString(it->first), obj));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("commands", commands));
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
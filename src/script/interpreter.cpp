@@ -12,6 +12,7 @@
 #include "eccryptoverify.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 using namespace std;
@@ -1031,9 +1032,36 @@ public:
     }
 };
 
+//! Size of a blanked input: prevout, empty script and nSequence
+const size_t BLANK_INPUT_SIZE = 36 + 1 + 4;
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo) : nInputsBegin(0)
+{
+    if (txTo.vin.size() < PRECOMPUTE_MIN_INPUTS)
+        return;
+
+    // Signing an input past the last one blanks them all
+    CScript scriptEmpty;
+    CTransactionSignatureSerializer txBlank(txTo, scriptEmpty, txTo.vin.size(), SIGHASH_ALL);
+    CDataStream ss(SER_GETHASH, 0);
+    ss << txBlank;
+    vchBlank.assign(ss.begin(), ss.end());
+    nInputsBegin = sizeof(txTo.nVersion) + GetSizeOfCompactSize(txTo.vin.size());
+
+    vHashPrefix.reserve(txTo.vin.size());
+    CHashWriter hasher(SER_GETHASH, 0);
+    size_t nHashed = 0;
+    for (unsigned int i = 0; i < txTo.vin.size(); i++) {
+        size_t nScript = nInputsBegin + i * BLANK_INPUT_SIZE + 36;
+        hasher.write((const char*)&vchBlank[nHashed], nScript - nHashed);
+        nHashed = nScript;
+        vHashPrefix.push_back(hasher);
+    }
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache)
 {
     if (nIn >= txTo.vin.size()) {
         //  nIn out of range
@@ -1051,6 +1079,18 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // Hash types that commit to all inputs and outputs resume from the precomputed
+    // state at this input's script, then hash the rest of the blanked transaction
+    bool fAll = !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE;
+    if (fAll && cache && cache->vHashPrefix.size() == txTo.vin.size()) {
+        CHashWriter ss(cache->vHashPrefix[nIn]);
+        txTmp.SerializeScriptCode(ss, SER_GETHASH, 0);
+        size_t nRest = cache->nInputsBegin + nIn * BLANK_INPUT_SIZE + 37;
+        ss.write((const char*)&cache->vchBlank[nRest], cache->vchBlank.size() - nRest);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1075,7 +1115,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
@@ -72,7 +73,31 @@ enum
 
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/** Transactions with fewer inputs are cheaper to hash directly than to precompute */
+static const unsigned int PRECOMPUTE_MIN_INPUTS = 5;
+
+/**
+ * Serialization of a transaction shared by the signature checks of all its
+ * inputs. Signature hashes that commit to every input and output only differ in
+ * the script of the input being signed, so the transaction is serialized once
+ * with all input scripts blanked, and the hash state is kept at the script of
+ * each input. An input's signature hash then only hashes its script code and the
+ * rest of the transaction, instead of reserializing the whole transaction.
+ */
+struct PrecomputedTransactionData
+{
+    //! txTo serialized for SIGHASH_ALL with every input script empty
+    std::vector<unsigned char> vchBlank;
+    //! Offset of the first input in vchBlank
+    unsigned int nInputsBegin;
+    //! Hash states after vchBlank up to the script of each input, or empty if not precomputed
+    std::vector<CHashWriter> vHashPrefix;
+
+    PrecomputedTransactionData() : nInputsBegin(0) {}
+    explicit PrecomputedTransactionData(const CTransaction& txTo);
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache = NULL);
 
 class BaseSignatureChecker
 {
@@ -90,12 +115,13 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
 };
 
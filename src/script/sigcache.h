@@ -8,9 +8,16 @@
 
 #include "script/interpreter.h"
 
+#include <stdint.h>
 #include <vector>
 
 class CPubKey;
+struct CCuckooCacheStats;
+
+//! Default -maxsigcachesize in MiB, for about a million entries
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+//! Largest accepted -maxsigcachesize in MiB; larger values are old-style entry counts
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 1024;
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
@@ -18,9 +25,13 @@ private:
     bool store;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, bool storeIn=true) : TransactionSignatureChecker(txToIn, nInIn), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, bool storeIn = true, const PrecomputedTransactionData* txdataIn = NULL) : TransactionSignatureChecker(txToIn, nInIn, txdataIn), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Salt and size the signature cache from -maxsigcachesize; until then nothing is cached */
+void InitSignatureCache();
+CCuckooCacheStats GetSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
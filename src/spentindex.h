@@ -0,0 +1,78 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include "addressindex.h"
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** A spent output (-spentindex): 'p', txid, output index */
+class CSpentIndexKey
+{
+public:
+    uint256 txid;
+    unsigned int outputIndex;
+
+    CSpentIndexKey() : outputIndex(0) {}
+    CSpentIndexKey(const uint256& txidIn, unsigned int outputIndexIn) : txid(txidIn), outputIndex(outputIndexIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(outputIndex);
+    }
+};
+
+/** The input that spent an output, along with what was spent; a null value erases the entry */
+class CSpentIndexValue
+{
+public:
+    uint256 txid;
+    unsigned int inputIndex;
+    int blockHeight;
+    CAmount satoshis;
+    unsigned char addressType;
+    uint160 addressHash;
+
+    CSpentIndexValue() { SetNull(); }
+    CSpentIndexValue(const uint256& txidIn, unsigned int inputIndexIn, int blockHeightIn, CAmount satoshisIn, unsigned char addressTypeIn, const uint160& addressHashIn) : txid(txidIn),
+                                                                                                                                                                          inputIndex(inputIndexIn),
+                                                                                                                                                                          blockHeight(blockHeightIn),
+                                                                                                                                                                          satoshis(satoshisIn),
+                                                                                                                                                                          addressType(addressTypeIn),
+                                                                                                                                                                          addressHash(addressHashIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(inputIndex);
+        READWRITE(blockHeight);
+        READWRITE(satoshis);
+        READWRITE(addressType);
+        READWRITE(addressHash);
+    }
+
+    void SetNull()
+    {
+        txid = uint256(0);
+        inputIndex = 0;
+        blockHeight = 0;
+        satoshis = 0;
+        addressType = ADDRESS_INDEX_NONE;
+        addressHash = uint160(0);
+    }
+
+    bool IsNull() const { return txid == uint256(0); }
+};
+
+#endif // BITCOIN_SPENTINDEX_H
@@ -27,6 +27,7 @@ std::map<uint256, CTransactionLock> mapTxLocks;
 std::map<COutPoint, uint256> mapLockedInputs;
 std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
 int nCompleteTXLocks;
+CCriticalSection cs_swifttx;
 
 //txlock - Locks transaction
 //
@@ -50,8 +51,11 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
-            return;
+        {
+            LOCK(cs_swifttx);
+            if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
+                return;
+            }
         }
 
         if (!IsIXTXValid(tx)) {
@@ -82,7 +86,10 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            {
+                LOCK(cs_swifttx);
+                mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            }
 
             LogPrintf("ProcessMessageSwiftTX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -91,35 +98,41 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             return;
 
         } else {
-            mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
-
             // can we get the conflicting transaction as proof?
 
             LogPrintf("ProcessMessageSwiftTX::ix - Transaction Lock Request: %s %s : rejected %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
                 tx.GetHash().ToString().c_str());
 
-            BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                if (!mapLockedInputs.count(in.prevout)) {
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
+            bool fReprocess = false;
+            {
+                LOCK(cs_swifttx);
+                mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+
+                BOOST_FOREACH (const CTxIn& in, tx.vin) {
+                    if (!mapLockedInputs.count(in.prevout)) {
+                        mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
+                    }
                 }
-            }
 
-            // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()) {
-                //we only care if we have a complete tx lock
-                if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-                    if (!CheckForConflictingLocks(tx)) {
-                        LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        ReprocessBlocks(15);
-                        mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+                // resolve conflicts
+                std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
+                if (i != mapTxLocks.end()) {
+                    //we only care if we have a complete tx lock
+                    if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
+                        if (!CheckForConflictingLocks(tx)) {
+                            LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
+                            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+                            fReprocess = true;
+                        }
                     }
                 }
             }
 
+            //reprocess the last 15 blocks
+            if (fReprocess)
+                ReprocessBlocks(15);
+
             return;
         }
     } else if (strCommand == "txlvote") // SwiftTX Lock Consensus Votes
@@ -130,11 +143,14 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockVote.count(ctx.GetHash())) {
-            return;
-        }
+        {
+            LOCK(cs_swifttx);
+            if (mapTxLockVote.count(ctx.GetHash())) {
+                return;
+            }
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
+            mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
+        }
 
         if (ProcessConsensusVote(pfrom, ctx)) {
             //Spam/Dos protection
@@ -143,19 +159,22 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 This tracks those messages and allows it at the same rate of the rest of the network, if
                 a peer violates it, it will simply be ignored
             */
-            if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
-                if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
+            {
+                LOCK(cs_swifttx);
+                if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
+                    if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    }
 
-                if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
-                    LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
-                        ctx.vinMasternode.ToString().c_str(),
-                        ctx.txHash.ToString().c_str());
-                    return;
-                } else {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
+                        LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
+                            ctx.vinMasternode.ToString().c_str(),
+                            ctx.txHash.ToString().c_str());
+                        return;
+                    } else {
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    }
                 }
             }
             RelayInv(inv);
@@ -165,6 +184,27 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
     }
 }
 
+void AddSignatureChecksSwiftTX(std::string& strCommand, CDataStream& vRecv, std::vector<CMasternodeSignatureCheck>& vChecks)
+{
+    if (fLiteMode) return; //disable all masternode related functionality
+    if (!IsSporkActive(SPORK_2_SWIFTTX)) return;
+    if (!masternodeSync.IsBlockchainSynced()) return;
+
+    if (strCommand == "txlvote") {
+        CConsensusVote ctx;
+        vRecv >> ctx;
+
+        {
+            LOCK(cs_swifttx);
+            if (mapTxLockVote.count(ctx.GetHash())) return;
+        }
+
+        CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
+        if (pmn != NULL)
+            vChecks.push_back(CMasternodeSignatureCheck(pmn->pubKeyMasternode, ctx.vchMasterNodeSignature, ctx.GetSignatureMessage()));
+    }
+}
+
 bool IsIXTXValid(const CTransaction& txCollateral)
 {
     if (txCollateral.vout.size() < 1) return false;
@@ -231,6 +271,7 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (chainActive.Tip()->nHeight - nTxAge) + 4;
 
+    LOCK(cs_swifttx);
     if (!mapTxLocks.count(tx.GetHash())) {
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
 
@@ -284,7 +325,10 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    {
+        LOCK(cs_swifttx);
+        mapTxLockVote[ctx.GetHash()] = ctx;
+    }
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
@@ -318,31 +362,35 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)) {
-        LogPrintf("SwiftTX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
-    } else
-        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
-
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()) {
-        (*i).second.AddSignature(ctx);
-
 #ifdef ENABLE_WALLET
-        if (pwalletMain) {
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if (pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
+    if (pwalletMain) {
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        LOCK(pwalletMain->cs_wallet);
+        if (pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+    }
 #endif
 
+    bool fComplete = false;
+    bool fReprocess = false;
+    {
+        LOCK(cs_swifttx);
+        if (!mapTxLocks.count(ctx.txHash)) {
+            LogPrintf("SwiftTX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
+
+            CTransactionLock newLock;
+            newLock.nBlockHeight = 0;
+            newLock.nExpiration = GetTime() + (60 * 60);
+            newLock.nTimeout = GetTime() + (60 * 5);
+            newLock.txHash = ctx.txHash;
+            mapTxLocks.insert(make_pair(ctx.txHash, newLock));
+        } else
+            LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
+
+        //compile consessus vote
+        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
+        (*i).second.AddSignature(ctx);
+
         LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
 
         if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
@@ -350,13 +398,7 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 
             CTransaction& tx = mapTxLockReq[ctx.txHash];
             if (!CheckForConflictingLocks(tx)) {
-#ifdef ENABLE_WALLET
-                if (pwalletMain) {
-                    if (pwalletMain->UpdatedTransaction((*i).second.txHash)) {
-                        nCompleteTXLocks++;
-                    }
-                }
-#endif
+                fComplete = true;
 
                 if (mapTxLockReq.count(ctx.txHash)) {
                     BOOST_FOREACH (const CTxIn& in, tx.vin) {
@@ -369,17 +411,26 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
                 // resolve conflicts
 
                 //if this tx lock was rejected, we need to remove the conflicting blocks
-                if (mapTxLockReqRejected.count((*i).second.txHash)) {
-                    //reprocess the last 15 blocks
-                    ReprocessBlocks(15);
-                }
+                fReprocess = mapTxLockReqRejected.count(ctx.txHash) != 0;
             }
         }
-        return true;
     }
 
+    // The wallet and the block reprocessing take their own locks, so cs_swifttx is released first
+    if (fComplete) {
+#ifdef ENABLE_WALLET
+        if (pwalletMain) {
+            if (pwalletMain->UpdatedTransaction(ctx.txHash)) {
+                nCompleteTXLocks++;
+            }
+        }
+#endif
 
-    return false;
+        //reprocess the last 15 blocks
+        if (fReprocess)
+            ReprocessBlocks(15);
+    }
+    return true;
 }
 
 bool CheckForConflictingLocks(CTransaction& tx)
@@ -391,6 +442,7 @@ bool CheckForConflictingLocks(CTransaction& tx)
         Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
+    LOCK(cs_swifttx);
     BOOST_FOREACH (const CTxIn& in, tx.vin) {
         if (mapLockedInputs.count(in.prevout)) {
             if (mapLockedInputs[in.prevout] != tx.GetHash()) {
@@ -407,6 +459,7 @@ bool CheckForConflictingLocks(CTransaction& tx)
 
 int64_t GetAverageVoteTime()
 {
+    LOCK(cs_swifttx);
     std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
     int64_t total = 0;
     int64_t count = 0;
@@ -424,6 +477,7 @@ void CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
+    LOCK(cs_swifttx);
     std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
 
     while (it != mapTxLocks.end()) {
@@ -450,16 +504,46 @@ void CleanTransactionLocksList()
     }
 }
 
+bool RestoreTransactionLock(const CTransaction& tx, const CTransactionLock& txLock)
+{
+    if (tx.GetHash() != txLock.txHash)
+        return error("%s : lock %s does not belong to transaction %s", __func__, txLock.txHash.ToString(), tx.GetHash().ToString());
+
+    // Runs on the import thread while peers may already be sending locks and votes
+    LOCK(cs_swifttx);
+    if (mapTxLocks.count(txLock.txHash))
+        return true;
+
+    mapTxLockReq.insert(make_pair(txLock.txHash, tx));
+    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.insert(make_pair(txLock.txHash, txLock)).first;
+    BOOST_FOREACH (const CConsensusVote& vote, txLock.vecConsensusVotes)
+        mapTxLockVote.insert(make_pair(vote.GetHash(), vote));
+
+    // Votes were checked when they first arrived, a complete lock locks its inputs again
+    if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
+        BOOST_FOREACH (const CTxIn& in, tx.vin) {
+            if (!mapLockedInputs.count(in.prevout))
+                mapLockedInputs.insert(make_pair(in.prevout, txLock.txHash));
+        }
+    }
+    return true;
+}
+
 uint256 CConsensusVote::GetHash() const
 {
     return vinMasternode.prevout.hash + vinMasternode.prevout.n + txHash;
 }
 
 
+std::string CConsensusVote::GetSignatureMessage() const
+{
+    return txHash.ToString() + boost::lexical_cast<std::string>(nBlockHeight);
+}
+
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetSignatureMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
     CMasternode* pmn = mnodeman.Find(vinMasternode);
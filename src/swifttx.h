@@ -32,6 +32,7 @@ using namespace boost;
 class CConsensusVote;
 class CTransaction;
 class CTransactionLock;
+class CMasternodeSignatureCheck;
 
 static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
 
@@ -41,6 +42,9 @@ extern map<uint256, CConsensusVote> mapTxLockVote;
 extern map<uint256, CTransactionLock> mapTxLocks;
 extern std::map<COutPoint, uint256> mapLockedInputs;
 extern int nCompleteTXLocks;
+// guards the transaction lock maps above. Always taken last, after cs_main and cs_wallet:
+// no other lock may be acquired while it is held.
+extern CCriticalSection cs_swifttx;
 
 
 int64_t CreateNewLock(CTransaction tx);
@@ -51,6 +55,7 @@ bool IsIXTXValid(const CTransaction& txCollateral);
 bool CheckForConflictingLocks(CTransaction& tx);
 
 void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+void AddSignatureChecksSwiftTX(std::string& strCommand, CDataStream& vRecv, std::vector<CMasternodeSignatureCheck>& vChecks);
 
 //check if we need to vote on this transaction
 void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
@@ -61,6 +66,9 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
 // keep transaction locks in memory for an hour
 void CleanTransactionLocksList();
 
+// restore a transaction lock saved with the mempool, false if it is not the lock of tx
+bool RestoreTransactionLock(const CTransaction& tx, const CTransactionLock& txLock);
+
 int64_t GetAverageVoteTime();
 
 class CConsensusVote
@@ -75,6 +83,7 @@ public:
 
     bool SignatureValid();
     bool Sign();
+    std::string GetSignatureMessage() const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -105,6 +114,18 @@ public:
     {
         return txHash;
     }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nBlockHeight);
+        READWRITE(txHash);
+        READWRITE(vecConsensusVotes);
+        READWRITE(nExpiration);
+        READWRITE(nTimeout);
+    }
 };
 
 
@@ -0,0 +1,226 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "script/sign.h"
+#include "spentindex.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern std::set<CBlockIndex*> setDirtyBlockIndex;
+
+static std::string SerializeAddressIndexKey(const CAddressIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return ss.str();
+}
+
+// Everything the indexes hold for two addresses and one outpoint, for comparing before and after
+static std::string IndexSnapshot(const uint160& hashFrom, const uint160& hashTo, const COutPoint& prevout)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    const uint160* hashes[] = {&hashFrom, &hashTo};
+    for (int i = 0; i < 2; i++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vAddress;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+        BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, *hashes[i], vAddress));
+        BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, *hashes[i], vUnspent));
+        ss << vAddress << vUnspent;
+    }
+    CSpentIndexValue spent;
+    if (pblocktree->ReadSpentIndex(CSpentIndexKey(prevout.hash, prevout.n), spent))
+        ss << spent;
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_AUTO_TEST_CASE(addressindex_key_order)
+{
+    uint160 hashBytes(1);
+    CAddressIndexKey key1(ADDRESS_INDEX_PUBKEYHASH, hashBytes, 1, 300, uint256(2), 0, false);
+    CAddressIndexKey key2(ADDRESS_INDEX_PUBKEYHASH, hashBytes, 2, 0, uint256(1), 0, false);
+    CAddressIndexKey key256(ADDRESS_INDEX_PUBKEYHASH, hashBytes, 256, 0, uint256(1), 0, false);
+
+    std::string str1 = SerializeAddressIndexKey(key1);
+    std::string str256 = SerializeAddressIndexKey(key256);
+    BOOST_CHECK_EQUAL(str256.size(), 66U);
+    BOOST_CHECK_EQUAL(str256.size(), key256.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    // The height follows type and address hash, most significant byte first
+    BOOST_CHECK_EQUAL(str256.substr(21, 4), std::string("\x00\x00\x01\x00", 4));
+
+    // The height decides the order before the position in the block and the txid
+    BOOST_CHECK(str1 < SerializeAddressIndexKey(key2));
+    BOOST_CHECK(SerializeAddressIndexKey(key2) < str256);
+
+    CAddressIndexKey keyRead;
+    CDataStream ss(str256.data(), str256.data() + str256.size(), SER_DISK, CLIENT_VERSION);
+    ss >> keyRead;
+    BOOST_CHECK_EQUAL(keyRead.type, key256.type);
+    BOOST_CHECK(keyRead.hashBytes == key256.hashBytes);
+    BOOST_CHECK_EQUAL(keyRead.blockHeight, 256);
+    BOOST_CHECK_EQUAL(keyRead.txindex, 0U);
+    BOOST_CHECK(keyRead.txhash == key256.txhash);
+    BOOST_CHECK_EQUAL(keyRead.index, 0U);
+    BOOST_CHECK(!keyRead.spending);
+
+    CAddressUnspentKey keyUnspent(ADDRESS_INDEX_SCRIPTHASH, hashBytes, uint256(1), 256);
+    CDataStream ssUnspent(SER_DISK, CLIENT_VERSION);
+    ssUnspent << keyUnspent;
+    BOOST_CHECK_EQUAL(ssUnspent.size(), 57U);
+    BOOST_CHECK_EQUAL(ssUnspent.str().substr(53, 4), std::string("\x00\x00\x01\x00", 4));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_range_scan)
+{
+    uint160 hashA(1);
+    uint160 hashB(2);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    const int heights[] = {70000, 1, 256, 255};
+    for (int i = 0; i < 4; i++)
+        vEntries.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashA, heights[i], 0, uint256(heights[i]), 0, false), heights[i] * COIN));
+    // Neighbouring keys that a scan of hashA must not return
+    vEntries.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashB, 1, 0, uint256(1), 1, false), COIN));
+    vEntries.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_SCRIPTHASH, hashA, 100, 0, uint256(1), 2, false), COIN));
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vEntries));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRead;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 4U);
+    const int heightsSorted[] = {1, 255, 256, 70000};
+    for (unsigned int i = 0; i < vRead.size() && i < 4; i++) {
+        BOOST_CHECK_EQUAL(vRead[i].first.blockHeight, heightsSorted[i]);
+        BOOST_CHECK_EQUAL(vRead[i].second, heightsSorted[i] * COIN);
+    }
+
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vRead, 255, 256));
+    BOOST_CHECK_EQUAL(vRead.size(), 2U);
+    if (vRead.size() == 2) {
+        BOOST_CHECK_EQUAL(vRead[0].first.blockHeight, 255);
+        BOOST_CHECK_EQUAL(vRead[1].first.blockHeight, 256);
+    }
+
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vRead, 257));
+    BOOST_CHECK_EQUAL(vRead.size(), 1U);
+    if (vRead.size() == 1)
+        BOOST_CHECK_EQUAL(vRead[0].first.blockHeight, 70000);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashA, uint256(1), 0), CAddressUnspentValue(COIN, CScript(), 1)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashA, uint256(2), 1), CAddressUnspentValue(2 * COIN, CScript(), 2)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashB, uint256(1), 0), CAddressUnspentValue(COIN, CScript(), 1)));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vUnspent));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentRead;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vUnspentRead));
+    BOOST_CHECK_EQUAL(vUnspentRead.size(), 2U);
+
+    // Null values erase
+    for (unsigned int i = 0; i < vUnspent.size(); i++)
+        vUnspent[i].second.SetNull();
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vUnspent));
+    vUnspentRead.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vUnspentRead));
+    BOOST_CHECK(vUnspentRead.empty());
+
+    BOOST_CHECK(pblocktree->EraseAddressIndex(vEntries));
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vRead));
+    BOOST_CHECK(vRead.empty());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect)
+{
+    LOCK(cs_main);
+    bool fAddressIndexOld = fAddressIndex;
+    bool fSpentIndexOld = fSpentIndex;
+    fAddressIndex = true;
+    fSpentIndex = true;
+
+    CBasicKeyStore keystore;
+    CKey keyFrom, keyTo;
+    keyFrom.MakeNewKey(true);
+    keyTo.MakeNewKey(true);
+    keystore.AddKey(keyFrom);
+    uint160 hashFrom = keyFrom.GetPubKey().GetID();
+    uint160 hashTo = keyTo.GetPubKey().GetID();
+    CScript scriptFrom = GetScriptForDestination(keyFrom.GetPubKey().GetID());
+    CScript scriptTo = GetScriptForDestination(keyTo.GetPubKey().GetID());
+
+    // A coin of keyFrom, indexed as an earlier block would have left it
+    COutPoint prevout(GetRandHash(), 0);
+    pcoinsTip->AddCoin(prevout, Coin(CTxOut(10 * COIN, scriptFrom), 0, false, false), false);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vFunding;
+    vFunding.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashFrom, 0, 1, prevout.hash, 0, false), 10 * COIN));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vFundingUnspent;
+    vFundingUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashFrom, prevout.hash, 0), CAddressUnspentValue(10 * COIN, scriptFrom, 0)));
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vFunding));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vFundingUnspent));
+
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].prevout.SetNull();
+    txCoinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    txCoinbase.vout.push_back(CTxOut(0, scriptTo));
+    CMutableTransaction txSpend;
+    txSpend.vin.push_back(CTxIn(prevout));
+    txSpend.vout.push_back(CTxOut(10 * COIN, scriptTo));
+    BOOST_CHECK(SignSignature(keystore, scriptFrom, txSpend, 0));
+
+    CBlock block;
+    block.nVersion = 1;
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = pindexPrev->nTime + 60;
+    block.nBits = pindexPrev->nBits;
+    block.vtx.push_back(CTransaction(txCoinbase));
+    block.vtx.push_back(CTransaction(txSpend));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hashBlock;
+    index.pprev = pindexPrev;
+    index.nHeight = pindexPrev->nHeight + 1;
+
+    std::string strBefore = IndexSnapshot(hashFrom, hashTo, prevout);
+
+    CValidationState state;
+    CCoinsViewCache view(pcoinsTip);
+    BOOST_CHECK(ConnectBlock(block, state, &index, view, false, true));
+    BOOST_CHECK(IndexSnapshot(hashFrom, hashTo, prevout) != strBefore);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hashFrom, vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hashTo, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 2U);
+    CSpentIndexValue spent;
+    BOOST_CHECK(pblocktree->ReadSpentIndex(CSpentIndexKey(prevout.hash, prevout.n), spent));
+    BOOST_CHECK(spent.txid == txSpend.GetHash());
+    BOOST_CHECK_EQUAL(spent.blockHeight, index.nHeight);
+
+    BOOST_CHECK(DisconnectBlock(block, state, &index, view, true));
+    BOOST_CHECK(IndexSnapshot(hashFrom, hashTo, prevout) == strBefore);
+    BOOST_CHECK(view.GetBestBlock() == pindexPrev->GetBlockHash());
+    BOOST_CHECK(!view.AccessCoin(prevout).IsSpent());
+
+    setDirtyBlockIndex.erase(&index);
+    pcoinsTip->SpendCoin(prevout);
+    BOOST_CHECK(pblocktree->EraseAddressIndex(vFunding));
+    vFundingUnspent[0].second.SetNull();
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vFundingUnspent));
+    fAddressIndex = fAddressIndexOld;
+    fSpentIndex = fSpentIndexOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
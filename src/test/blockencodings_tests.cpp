@@ -0,0 +1,117 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(4);
+    block.vtx[0] = tx;
+    block.nVersion = 42;
+    block.hashPrevBlock = uint256(0);
+    block.nBits = 0x207fffff;
+
+    for (int i = 1; i < 4; i++) {
+        tx.vin[0].prevout.hash = block.vtx[i - 1].GetHash();
+        tx.vin[0].prevout.n = 0;
+        block.vtx[i] = tx;
+    }
+
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+// Send a compact block through the wire format, as the receiving node would see it
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    BOOST_CHECK_EQUAL(stream.size(), ::GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION));
+
+    CBlockHeaderAndShortTxIDs cmpctblockOut;
+    stream >> cmpctblockOut;
+    return cmpctblockOut;
+}
+
+BOOST_AUTO_TEST_CASE(reconstruct_from_mempool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlockTestCase());
+
+    // Everything but the last transaction is in the pool, along with an unrelated one
+    pool.addUnchecked(block.vtx[1].GetHash(), CTxMemPoolEntry(block.vtx[1], 0, 0, 0.0, 1, 1));
+    pool.addUnchecked(block.vtx[2].GetHash(), CTxMemPoolEntry(block.vtx[2], 0, 0, 0.0, 1, 1));
+    CMutableTransaction txOther(block.vtx[3]);
+    txOther.vout[0].nValue = 43;
+    pool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 0, 0, 0.0, 1, 1));
+
+    CBlockHeaderAndShortTxIDs cmpctblock(RoundTrip(CBlockHeaderAndShortTxIDs(block)));
+    BOOST_CHECK_EQUAL(cmpctblock.prefilledtxn.size(), 1U);
+    BOOST_CHECK_EQUAL(cmpctblock.shorttxids.size(), 3U);
+
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(3));
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 2U);
+
+    std::vector<uint32_t> vMissing = partialBlock.GetMissing();
+    BOOST_CHECK_EQUAL(vMissing.size(), 1U);
+    BOOST_CHECK_EQUAL(vMissing[0], 3U);
+
+    CBlock blockOut;
+    // Too few or too many transactions are the peer's fault
+    BOOST_CHECK(partialBlock.FillBlock(blockOut, std::vector<CTransaction>()) == READ_STATUS_INVALID);
+    BOOST_CHECK(partialBlock.FillBlock(blockOut, std::vector<CTransaction>(2, block.vtx[3])) == READ_STATUS_INVALID);
+    // The wrong transaction shows up in the merkle root
+    BOOST_CHECK(partialBlock.FillBlock(blockOut, std::vector<CTransaction>(1, txOther)) == READ_STATUS_FAILED);
+
+    BOOST_CHECK(partialBlock.FillBlock(blockOut, std::vector<CTransaction>(1, block.vtx[3])) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(blockOut.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(blockOut.hashMerkleRoot.ToString(), block.BuildMerkleTree().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(reconstruct_without_mempool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlockTestCase());
+
+    CBlockHeaderAndShortTxIDs cmpctblock(RoundTrip(CBlockHeaderAndShortTxIDs(block)));
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(partialBlock.GetMissing().size(), 3U);
+
+    std::vector<CTransaction> vtxMissing(block.vtx.begin() + 1, block.vtx.end());
+    CBlock blockOut;
+    BOOST_CHECK(partialBlock.FillBlock(blockOut, vtxMissing) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(blockOut.GetHash().ToString(), block.GetHash().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(invalid_prefilled_index)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlockHeaderAndShortTxIDs cmpctblock(BuildBlockTestCase());
+    cmpctblock.prefilledtxn[0].index = cmpctblock.BlockTxCount();
+
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,9 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "coins.h"
 #include "random.h"
+#include "script/script.h"
 #include "uint256.h"
+#include "undo.h"
+#include "streams.h"
+#include "utilstrencodings.h"
 
 #include <vector>
 #include <map>
@@ -16,27 +21,23 @@ namespace
 class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
-    std::map<uint256, CCoins> map_;
+    std::map<COutPoint, Coin> map_;
 
 public:
-    bool GetCoins(const uint256& txid, CCoins& coins) const
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
     {
-        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        std::map<COutPoint, Coin>::const_iterator it = map_.find(outpoint);
         if (it == map_.end()) {
             return false;
         }
-        coins = it->second;
-        if (coins.IsPruned() && insecure_rand() % 2 == 0) {
-            // Randomly return false in case of an empty entry.
-            return false;
-        }
-        return true;
+        coin = it->second;
+        return !coin.IsSpent();
     }
 
-    bool HaveCoins(const uint256& txid) const
+    bool HaveCoin(const COutPoint& outpoint) const
     {
-        CCoins coins;
-        return GetCoins(txid, coins);
+        Coin coin;
+        return GetCoin(outpoint, coin);
     }
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
@@ -44,10 +45,12 @@ public:
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
-            map_[it->first] = it->second.coins;
-            if (it->second.coins.IsPruned() && insecure_rand() % 3 == 0) {
-                // Randomly delete empty entries on write.
-                map_.erase(it->first);
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                map_[it->first] = it->second.coin;
+                if (it->second.coin.IsSpent() && insecure_rand() % 3 == 0) {
+                    // Randomly delete spent entries on write.
+                    map_.erase(it->first);
+                }
             }
             mapCoins.erase(it++);
         }
@@ -57,6 +60,8 @@ public:
     }
 
     bool GetStats(CCoinsStats& stats) const { return false; }
+
+    size_t size() const { return map_.size(); }
 };
 }
 
@@ -67,8 +72,8 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 // This is a large randomized insert/remove simulation test on a variable-size
 // stack of caches on top of CCoinsViewTest.
 //
-// It will randomly create/update/delete CCoins entries to a tip of caches, with
-// txids picked from a limited list of random 256-bit hashes. Occasionally, a
+// It will randomly create/update/delete Coin entries to a tip of caches, with
+// outpoints picked from a limited list of random 256-bit hashes. Occasionally, a
 // new tip is added to the stack of caches, or the tip is flushed and removed.
 //
 // During the process, booleans are kept to make sure that the randomized
@@ -85,53 +90,54 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool missed_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
     std::vector<CCoinsViewCache*> stack; // A stack of CCoinsViewCaches on top.
     stack.push_back(new CCoinsViewCache(&base)); // Start with one cache.
 
-    // Use a limited set of random transaction ids, so we do test overwriting entries.
-    std::vector<uint256> txids;
-    txids.resize(NUM_SIMULATION_ITERATIONS / 8);
-    for (unsigned int i = 0; i < txids.size(); i++) {
-        txids[i] = GetRandHash();
+    // Use a limited set of random outpoints, so we do test overwriting entries.
+    std::vector<COutPoint> outpoints;
+    outpoints.resize(NUM_SIMULATION_ITERATIONS / 8);
+    for (unsigned int i = 0; i < outpoints.size(); i++) {
+        outpoints[i] = COutPoint(GetRandHash(), insecure_rand() % 4);
     }
 
     for (unsigned int i = 0; i < NUM_SIMULATION_ITERATIONS; i++) {
         // Do a random modification.
         {
-            uint256 txid = txids[insecure_rand() % txids.size()]; // txid we're going to modify in this iteration.
-            CCoins& coins = result[txid];
-            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
-            BOOST_CHECK(coins == *entry);
-            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
-                if (coins.IsPruned()) {
+            COutPoint outpoint = outpoints[insecure_rand() % outpoints.size()]; // outpoint we're going to modify in this iteration.
+            Coin& coin = result[outpoint];
+            const Coin& entry = stack.back()->AccessCoin(outpoint);
+            BOOST_CHECK(coin == entry);
+            if (insecure_rand() % 5 == 0 || coin.IsSpent()) {
+                if (coin.IsSpent()) {
                     added_an_entry = true;
                 } else {
                     updated_an_entry = true;
                 }
-                coins.nVersion = insecure_rand();
-                coins.vout.resize(1);
-                coins.vout[0].nValue = insecure_rand();
-                *entry = coins;
+                coin.out.nValue = insecure_rand();
+                coin.nHeight = 1 + insecure_rand() % 100000;
+                coin.fCoinStake = insecure_rand() % 2;
+                stack.back()->AddCoin(outpoint, coin, !entry.IsSpent() || insecure_rand() % 2);
             } else {
-                coins.Clear();
-                entry->Clear();
+                coin.Clear();
+                stack.back()->SpendCoin(outpoint);
                 removed_an_entry = true;
             }
         }
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
+            for (std::map<COutPoint, Coin>::iterator it = result.begin(); it != result.end(); it++) {
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(coin == it->second);
+                if (!coin.IsSpent()) {
+                    BOOST_CHECK(stack.back()->HaveCoin(it->first));
                     found_an_entry = true;
                 } else {
-                    BOOST_CHECK(it->second.IsPruned());
+                    BOOST_CHECK(!stack.back()->HaveCoin(it->first));
                     missed_an_entry = true;
                 }
             }
@@ -175,4 +181,75 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coin_serialization)
+{
+    Coin coin(CTxOut(50 * COIN, CScript() << OP_TRUE), 123456, false, true);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << coin;
+    BOOST_CHECK_EQUAL(ss.size(), coin.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    // The header packs the flags like CTxInUndo, whose version field is only present after it
+    CTxInUndo undo(coin);
+    CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+    ssUndo << undo;
+    BOOST_CHECK_EQUAL(HexStr(ss.begin(), ss.begin() + 3), HexStr(ssUndo.begin(), ssUndo.begin() + 3));
+
+    Coin coin2;
+    ss >> coin2;
+    BOOST_CHECK(coin2 == coin);
+    BOOST_CHECK(coin2.IsCoinStake() && !coin2.IsCoinBase());
+    BOOST_CHECK_EQUAL(coin2.nHeight, 123456U);
+}
+
+// A coin created and spent between two flushes never reaches the database
+BOOST_AUTO_TEST_CASE(coins_fresh_spend_not_flushed)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+    COutPoint outpoint(GetRandHash(), 1);
+    cache.AddCoin(outpoint, Coin(CTxOut(COIN, CScript() << OP_TRUE), 10, false, false), false);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK(cache.SpendCoin(outpoint));
+    BOOST_CHECK(!cache.SpendCoin(outpoint));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    cache.Flush();
+    BOOST_CHECK_EQUAL(base.size(), 0U);
+
+    // Unspendable outputs are never added at all
+    cache.AddCoin(outpoint, Coin(CTxOut(COIN, CScript() << OP_RETURN), 10, false, false), false);
+    BOOST_CHECK(!cache.HaveCoin(outpoint));
+}
+
+// Sync writes the dirty entries but keeps the unspent ones cached, and the memory usage follows the cache
+BOOST_AUTO_TEST_CASE(coins_sync_keeps_cache)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+    size_t nEmptyUsage = cache.DynamicMemoryUsage();
+    COutPoint outpoint1(GetRandHash(), 0);
+    COutPoint outpoint2(GetRandHash(), 0);
+    CScript script = CScript() << std::vector<unsigned char>(100, 1) << OP_DROP << OP_TRUE;
+    cache.AddCoin(outpoint1, Coin(CTxOut(COIN, script), 10, false, false), false);
+    cache.AddCoin(outpoint2, Coin(CTxOut(COIN, script), 10, false, false), false);
+    size_t nFullUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nFullUsage > nEmptyUsage);
+
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.size(), 2U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nFullUsage);
+
+    // A clean entry spent after a sync still has to reach the database
+    BOOST_CHECK(cache.SpendCoin(outpoint1));
+    BOOST_CHECK(cache.DynamicMemoryUsage() < nFullUsage);
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.size(), 1U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint2));
+
+    cache.Flush();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(base.size(), 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
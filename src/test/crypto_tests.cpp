@@ -131,6 +131,38 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+// Every backend the CPU has agrees on SHA-256 and on SHA256D64 batches of any size
+BOOST_AUTO_TEST_CASE(sha256_implementations) {
+    static const sha256_implementation::UseImplementation uses[] = {
+        sha256_implementation::STANDARD,
+        sha256_implementation::USE_SSE4,
+        sha256_implementation::USE_AVX2,
+        sha256_implementation::UseImplementation(sha256_implementation::USE_SSE4 | sha256_implementation::USE_AVX2),
+        sha256_implementation::USE_SHANI,
+        sha256_implementation::USE_ALL};
+    unsigned char in[64 * 32], out[32 * 32], ref[32], tmp[32];
+    for (size_t u = 0; u < sizeof(uses) / sizeof(uses[0]); u++) {
+        std::string impl = SHA256AutoDetect(uses[u]);
+        BOOST_TEST_MESSAGE("SHA256 implementation: " << impl);
+        BOOST_CHECK(impl.find("self-test") == std::string::npos);
+
+        TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        TestSHA256(std::string(1000000, 'a'),
+                   "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+        for (size_t blocks = 0; blocks <= 32; blocks++) {
+            GetRandBytes(in, sizeof(in));
+            SHA256D64(out, in, blocks);
+            for (size_t i = 0; i < blocks; i++) {
+                CSHA256().Write(in + 64 * i, 64).Finalize(tmp);
+                CSHA256().Write(tmp, 32).Finalize(ref);
+                BOOST_CHECK_MESSAGE(memcmp(out + 32 * i, ref, 32) == 0, impl << " differs at " << i << " of " << blocks);
+            }
+        }
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -0,0 +1,151 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(cuckoocache_tests)
+
+static std::vector<uint256> RandomDigests(size_t n)
+{
+    std::vector<uint256> v(n);
+    for (size_t i = 0; i < n; i++)
+        v[i] = GetRandHash();
+    return v;
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_setup)
+{
+    CCuckooCache cache;
+    // Before Setup, and when sized to nothing, the cache holds nothing
+    uint256 digest = GetRandHash();
+    cache.Insert(digest);
+    BOOST_CHECK(!cache.Contains(digest, false));
+    BOOST_CHECK_EQUAL(cache.Setup(0), 0U);
+    cache.Insert(digest);
+    BOOST_CHECK(!cache.Contains(digest, false));
+
+    // 64-byte buckets of two entries, rounded down to a power of two
+    BOOST_CHECK_EQUAL(cache.Setup(64), 2U);
+    BOOST_CHECK_EQUAL(cache.Setup(1 << 20), (1U << 20) / 32);
+    BOOST_CHECK_EQUAL(cache.Setup((1 << 20) + (1 << 19)), (1U << 20) / 32);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 1U << 20);
+    BOOST_CHECK_EQUAL(cache.GetStats().nCapacity, (1U << 20) / 32);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_insert_erase)
+{
+    CCuckooCache cache;
+    size_t nCapacity = cache.Setup(1 << 20);
+    std::vector<uint256> digests = RandomDigests(nCapacity / 2);
+    for (size_t i = 0; i < digests.size(); i++)
+        cache.Insert(digests[i]);
+    // Inserting again is a no-op
+    cache.Insert(digests[0]);
+
+    // At half load every entry finds a place
+    for (size_t i = 0; i < digests.size(); i++)
+        BOOST_CHECK(cache.Contains(digests[i], false));
+    std::vector<uint256> unknown = RandomDigests(1000);
+    for (size_t i = 0; i < unknown.size(); i++)
+        BOOST_CHECK(!cache.Contains(unknown[i], false));
+
+    CCuckooCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nInserts, digests.size());
+    BOOST_CHECK_EQUAL(stats.nEvictions, 0U);
+    BOOST_CHECK_EQUAL(stats.nHits, digests.size());
+    BOOST_CHECK_EQUAL(stats.nMisses, unknown.size());
+
+    // Erasing lookups hit once
+    for (size_t i = 0; i < 100; i++) {
+        BOOST_CHECK(cache.Contains(digests[i], true));
+        BOOST_CHECK(!cache.Contains(digests[i], false));
+    }
+
+    // Setup empties the cache and its counters
+    cache.Setup(1 << 20);
+    BOOST_CHECK(!cache.Contains(digests[200], false));
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits, 0U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nInserts, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_full)
+{
+    CCuckooCache cache;
+    size_t nCapacity = cache.Setup(1 << 16);
+    std::vector<uint256> digests = RandomDigests(nCapacity * 2);
+    for (size_t i = 0; i < digests.size(); i++)
+        cache.Insert(digests[i]);
+
+    // Every insert past the capacity evicts an entry, and the table stays nearly full
+    size_t nFound = 0;
+    for (size_t i = 0; i < digests.size(); i++)
+        nFound += cache.Contains(digests[i], false);
+    CCuckooCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(nFound + stats.nEvictions, digests.size());
+    BOOST_CHECK(nFound > nCapacity * 9 / 10);
+    BOOST_CHECK(nFound <= nCapacity);
+    // The most recent entries are the most likely to remain
+    size_t nRecent = 0;
+    for (size_t i = digests.size() - 100; i < digests.size(); i++)
+        nRecent += cache.Contains(digests[i], false);
+    BOOST_CHECK(nRecent >= 90);
+}
+
+static void LookupAll(CCuckooCache* cache, const std::vector<uint256>* digests, size_t* nFound)
+{
+    for (size_t i = 0; i < digests->size(); i++)
+        *nFound += cache->Contains((*digests)[i], false);
+}
+
+static void InsertAll(CCuckooCache* cache, const std::vector<uint256>* digests)
+{
+    for (size_t i = 0; i < digests->size(); i++)
+        cache->Insert((*digests)[i]);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent)
+{
+    CCuckooCache cache;
+    size_t nCapacity = cache.Setup(1 << 20);
+    std::vector<uint256> present = RandomDigests(nCapacity / 8);
+    for (size_t i = 0; i < present.size(); i++)
+        cache.Insert(present[i]);
+    std::vector<uint256> added[2];
+    added[0] = RandomDigests(nCapacity / 8);
+    added[1] = RandomDigests(nCapacity / 8);
+
+    size_t nFound[4] = {0, 0, 0, 0};
+    boost::thread_group threads;
+    for (int t = 0; t < 4; t++)
+        threads.create_thread(boost::bind(&LookupAll, &cache, &present, &nFound[t]));
+    for (int t = 0; t < 2; t++)
+        threads.create_thread(boost::bind(&InsertAll, &cache, &added[t]));
+    threads.join_all();
+
+    // A lookup can miss an entry while an insert moves it to its other bucket,
+    // which only costs a signature check; nothing else may go missing
+    for (int t = 0; t < 4; t++)
+        BOOST_CHECK(nFound[t] >= present.size() * 99 / 100);
+    CCuckooCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nInserts, present.size() * 3);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 0U);
+    for (size_t i = 0; i < present.size(); i++)
+        BOOST_CHECK(cache.Contains(present[i], false));
+    for (int t = 0; t < 2; t++) {
+        for (size_t i = 0; i < added[t].size(); i++)
+            BOOST_CHECK(cache.Contains(added[t][i], false));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,7 +2,10 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/quark.h"
 #include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
 #include "utilstrencodings.h"
 
 #include <vector>
@@ -46,4 +49,53 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(siphash)
+{
+    // Reference output for key 000102..0f and message 000102..1f
+    uint256 x("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100");
+    BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, x), 0x7127512f72f27cceULL);
+}
+
+// The cached block hash follows every change of the header fields
+BOOST_AUTO_TEST_CASE(blockheader_hash_cache)
+{
+    CBlock block;
+    block.hashPrevBlock = GetRandHash();
+    block.hashMerkleRoot = GetRandHash();
+    block.nTime = 1500000000;
+    block.nBits = 0x1e0ffff0;
+    uint256 hash = block.GetHash();
+    BOOST_CHECK(hash == HashQuark(BEGIN(block.nVersion), END(block.nNonce)));
+    BOOST_CHECK(block.GetHash() == hash);
+    BOOST_CHECK(block.GetBlockHeader().GetHash() == hash);
+
+    block.nNonce++;
+    BOOST_CHECK(block.GetHash() != hash);
+    BOOST_CHECK(block.GetHash() == HashQuark(BEGIN(block.nVersion), END(block.nNonce)));
+    block.nNonce--;
+    BOOST_CHECK(block.GetHash() == hash);
+
+    block.hashMerkleRoot = GetRandHash();
+    BOOST_CHECK(block.GetHash() == HashQuark(BEGIN(block.nVersion), END(block.nNonce)));
+
+    block.SetNull();
+    BOOST_CHECK(block.GetHash() == CBlockHeader().GetHash());
+}
+
+// The CPU-specific Quark kernels agree with the sphlib chain on every input length
+BOOST_AUTO_TEST_CASE(quark_kernels)
+{
+    vector<unsigned char> empty;
+    BOOST_CHECK_EQUAL(HashQuark(empty.begin(), empty.end()).GetHex(), "9c7d513ab01c44694f7bc7c6a7e269a3eced7b2be24d8663835bf35a3bf10008");
+
+    unsigned char data[200];
+    unsigned char out[QUARK_OUTPUT_SIZE], ref[QUARK_OUTPUT_SIZE];
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        GetRandBytes(data, sizeof(data));
+        QuarkHash(data, len, out);
+        QuarkHashReference(data, len, ref);
+        BOOST_CHECK_MESSAGE(memcmp(out, ref, sizeof(out)) == 0, QuarkHashImplementation() << " differs for length " << len);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,9 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "key.h"
+#include "keystore.h"
 #include "main.h"
+#include "script/sign.h"
 #include "txmempool.h"
 #include "util.h"
+#include "test/test_pandemia.h"
 
 #include <boost/test/unit_test.hpp>
 #include <list>
@@ -58,17 +62,17 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     BOOST_CHECK_EQUAL(removed.size(), 0);
 
     // Just the parent:
-    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1, 1));
     testPool.remove(txParent, removed, true);
     BOOST_CHECK_EQUAL(removed.size(), 1);
     removed.clear();
     
     // Parent, children, grandchildren:
-    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1, 1));
     for (int i = 0; i < 3; i++)
     {
-        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1));
-        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1));
+        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1, 1));
+        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1, 1));
     }
     // Remove Child[0], GrandChild[0] should be removed:
     testPool.remove(txChild[0], removed, true);
@@ -88,8 +92,8 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     // Add children and grandchildren, but NOT the parent (simulate the parent being in a block)
     for (int i = 0; i < 3; i++)
     {
-        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1));
-        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1));
+        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1, 1));
+        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1, 1));
     }
     // Now remove the parent, as might happen if a block-re-org occurs but the parent cannot be
     // put into the mempool (maybe because it is non-standard):
@@ -99,4 +103,169 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    // A well paying transaction, a cheap one and a cheap parent whose child pays for both
+    CMutableTransaction tx1 = MempoolTestTx(uint256(1));
+    CMutableTransaction tx2 = MempoolTestTx(uint256(2));
+    CMutableTransaction tx3 = MempoolTestTx(tx2.GetHash());
+    CMutableTransaction tx4 = MempoolTestTx(uint256(4));
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 5000, 0, 0.0, 1, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 1000, 0, 0.0, 1, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 20000, 0, 0.0, 1, 1));
+    pool.addUnchecked(tx4.GetHash(), CTxMemPoolEntry(tx4, 100, 0, 0.0, 1, 1));
+    BOOST_CHECK_EQUAL(pool.mapTx[tx2.GetHash()].GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(pool.mapTx[tx2.GetHash()].GetFeesWithDescendants(), 21000);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    // The cheapest transaction goes first and raises the minimum fee above its own rate
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(tx4.GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    CFeeRate rateTx4(100, pool.mapTx[tx1.GetHash()].GetTxSize());
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), rateTx4.GetFeePerK() + 1000);
+
+    // The cheap parent is kept for its child, over a transaction paying more on its own
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+
+    // Parent and child leave together
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolMinFeeReorgTest)
+{
+    LOCK(cs_main);
+    CTxMemPool pool(CFeeRate(1000));
+
+    // A standard transaction spending a coin of the tip and paying a little over the relay fee
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    COutPoint prevout(GetRandHash(), 0);
+    pcoinsTip->AddCoin(prevout, Coin(CTxOut(11 * COIN, scriptPubKey), 1, false, false), false);
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout));
+    tx.vout.push_back(CTxOut(11 * COIN - 10000, scriptPubKey));
+    BOOST_CHECK(SignSignature(keystore, scriptPubKey, tx, 0));
+
+    // Trimming a well paying transaction raises the pool's minimum fee far above it
+    CMutableTransaction txEvicted = MempoolTestTx(uint256(1));
+    pool.addUnchecked(txEvicted.GetHash(), CTxMemPoolEntry(txEvicted, COIN, 0, 0.0, 1, 1));
+    pool.TrimToSize(0);
+    BOOST_CHECK(pool.GetMinFee(1).GetFee(::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION)) > 10000);
+
+    // Relayed it is turned away, coming back from a disconnected block it is let in
+    CValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPool(pool, state, tx, true, NULL));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "mempool min fee not met");
+    BOOST_CHECK(AcceptToMemoryPool(pool, state, tx, false, NULL));
+    BOOST_CHECK(pool.exists(tx.GetHash()));
+
+    pcoinsTip->SpendCoin(prevout);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // Same sized transactions, a cheap parent and its well paying child
+    CMutableTransaction tx1 = MempoolTestTx(uint256(1));
+    CMutableTransaction tx2 = MempoolTestTx(uint256(2));
+    CMutableTransaction tx3 = MempoolTestTx(tx2.GetHash());
+    CMutableTransaction tx4 = MempoolTestTx(uint256(4));
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 5000, 0, 0.0, 1, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 1000, 0, 0.0, 1, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 20000, 0, 0.0, 1, 1));
+    pool.addUnchecked(tx4.GetHash(), CTxMemPoolEntry(tx4, 100, 0, 0.0, 1, 1));
+    BOOST_CHECK_EQUAL(pool.mapTx[tx3.GetHash()].GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(pool.mapTx[tx3.GetHash()].GetModFeesWithAncestors(), 21000);
+    BOOST_CHECK_EQUAL(pool.mapTx[tx3.GetHash()].GetSigOpCountWithAncestors(), 2U);
+
+    // The package of parent and child goes first, at the package rate
+    std::vector<uint256> vOrder;
+    for (std::set<CTxMemPoolAncestorScore>::const_iterator it = pool.setTxByAncestorScore.begin(); it != pool.setTxByAncestorScore.end(); it++)
+        vOrder.push_back(it->hash);
+    BOOST_CHECK(vOrder[0] == tx3.GetHash());
+    BOOST_CHECK(vOrder[1] == tx1.GetHash());
+    BOOST_CHECK(vOrder[2] == tx2.GetHash());
+    BOOST_CHECK(vOrder[3] == tx4.GetHash());
+
+    // Prioritising the parent lifts it and its child's package
+    pool.PrioritiseTransaction(tx2.GetHash(), tx2.GetHash().ToString(), 0.0, 10000);
+    BOOST_CHECK_EQUAL(pool.mapTx[tx3.GetHash()].GetModFeesWithAncestors(), 31000);
+    BOOST_CHECK_EQUAL(pool.mapTx[tx2.GetHash()].GetFeesWithDescendants(), 31000);
+    BOOST_CHECK(pool.setTxByAncestorScore.begin()->hash == tx3.GetHash());
+    BOOST_CHECK((++pool.setTxByAncestorScore.begin())->hash == tx2.GetHash());
+
+    // Once the parent is mined the child is a package of its own
+    std::list<CTransaction> removed;
+    pool.remove(tx2, removed, false);
+    BOOST_CHECK_EQUAL(pool.mapTx[tx3.GetHash()].GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(pool.mapTx[tx3.GetHash()].GetSizeWithAncestors(), pool.mapTx[tx3.GetHash()].GetTxSize());
+    BOOST_CHECK_EQUAL(pool.mapTx[tx3.GetHash()].GetModFeesWithAncestors(), 20000);
+    BOOST_CHECK_EQUAL(pool.setTxByAncestorScore.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolExpiryTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // An old parent takes its newer child with it
+    CMutableTransaction txOld = MempoolTestTx(uint256(1));
+    CMutableTransaction txChild = MempoolTestTx(txOld.GetHash());
+    CMutableTransaction txNew = MempoolTestTx(uint256(2));
+    pool.addUnchecked(txOld.GetHash(), CTxMemPoolEntry(txOld, 0, 100, 0.0, 1, 1));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 0, 300, 0.0, 1, 1));
+    pool.addUnchecked(txNew.GetHash(), CTxMemPoolEntry(txNew, 0, 300, 0.0, 1, 1));
+
+    BOOST_CHECK_EQUAL(pool.Expire(100), 0);
+    BOOST_CHECK_EQUAL(pool.Expire(200), 2);
+    BOOST_CHECK(pool.exists(txNew.GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolChainLimitTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    LOCK(pool.cs);
+
+    // A chain of five transactions
+    std::vector<CMutableTransaction> vChain;
+    vChain.push_back(MempoolTestTx(uint256(1)));
+    for (int i = 1; i < 5; i++)
+        vChain.push_back(MempoolTestTx(vChain.back().GetHash()));
+    for (int i = 0; i < 5; i++)
+        pool.addUnchecked(vChain[i].GetHash(), CTxMemPoolEntry(vChain[i], 0, 0, 0.0, 1, 1));
+
+    CMutableTransaction txNext = MempoolTestTx(vChain.back().GetHash());
+    CTxMemPoolEntry entry(txNext, 0, 0, 0.0, 1, 1);
+    uint64_t nSize = entry.GetTxSize();
+    std::set<uint256> setAncestors;
+    std::string errString;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nSize, 6, 6 * nSize, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 5U);
+
+    // One transaction too many, for itself or for the first in the chain
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 5, 6 * nSize, 6, 6 * nSize, errString));
+    BOOST_CHECK(errString.find("ancestors") != std::string::npos);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nSize, 5, 6 * nSize, errString));
+    BOOST_CHECK(errString.find("descendants") != std::string::npos);
+
+    // One byte too many
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nSize - 1, 6, 6 * nSize, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nSize, 6, 6 * nSize - 1, errString));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
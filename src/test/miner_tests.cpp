@@ -8,6 +8,7 @@
 #include "pubkey.h"
 #include "uint256.h"
 #include "util.h"
+#include "test/test_pandemia.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -104,7 +105,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     {
         tx.vout[0].nValue -= 1000000;
         hash = tx.GetHash();
-        mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+        mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
         tx.vin[0].prevout.hash = hash;
     }
     BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
@@ -124,17 +125,18 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     {
         tx.vout[0].nValue -= 10000000;
         hash = tx.GetHash();
-        mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+        mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
         tx.vin[0].prevout.hash = hash;
     }
     BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
     delete pblocktemplate;
     mempool.clear();
 
-    // orphan in mempool
+    // orphan in mempool, left out of the block
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
     delete pblocktemplate;
     mempool.clear();
 
@@ -143,7 +145,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     tx.vin[0].prevout.hash = txFirst[1]->GetHash();
     tx.vout[0].nValue = 4900000000LL;
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     tx.vin[0].prevout.hash = hash;
     tx.vin.resize(2);
     tx.vin[1].scriptSig = CScript() << OP_1;
@@ -151,7 +153,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     tx.vin[1].prevout.n = 0;
     tx.vout[0].nValue = 5900000000LL;
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
     delete pblocktemplate;
     mempool.clear();
@@ -162,7 +164,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     tx.vin[0].scriptSig = CScript() << OP_0 << OP_1;
     tx.vout[0].nValue = 0;
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
     delete pblocktemplate;
     mempool.clear();
@@ -175,27 +177,31 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     script = CScript() << OP_0;
     tx.vout[0].scriptPubKey = GetScriptForDestination(CScriptID(script));
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     tx.vin[0].prevout.hash = hash;
     tx.vin[0].scriptSig = CScript() << (std::vector<unsigned char>)script;
     tx.vout[0].nValue -= 1000000;
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    // The P2SH output is fine to create, but spending it fails the script check
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == tx.vin[0].prevout.hash);
     delete pblocktemplate;
     mempool.clear();
 
-    // double spend txn pair in mempool
+    // double spend txn pair in mempool, only one of them makes it into the block
     tx.vin[0].prevout.hash = txFirst[0]->GetHash();
     tx.vin[0].scriptSig = CScript() << OP_1;
     tx.vout[0].nValue = 4900000000LL;
     tx.vout[0].scriptPubKey = CScript() << OP_1;
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     tx.vout[0].scriptPubKey = CScript() << OP_2;
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
     delete pblocktemplate;
     mempool.clear();
 
@@ -220,7 +226,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     tx.vout[0].scriptPubKey = CScript() << OP_1;
     tx.nLockTime = chainActive.Tip()->nHeight+1;
     hash = tx.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx)));
     BOOST_CHECK(!IsFinalTx(tx, chainActive.Tip()->nHeight + 1));
 
     // time locked
@@ -234,7 +240,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     tx2.vout[0].scriptPubKey = CScript() << OP_1;
     tx2.nLockTime = chainActive.Tip()->GetMedianTimePast()+1;
     hash = tx2.GetHash();
-    mempool.addUnchecked(hash, CTxMemPoolEntry(tx2, 11, GetTime(), 111.0, 11));
+    mempool.addUnchecked(hash, CTxMemPoolEntry(tx2, 11, GetTime(), 111.0, 11, GetLegacySigOpCount(tx2)));
     BOOST_CHECK(!IsFinalTx(tx2));
 
     BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
@@ -264,4 +270,36 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     Checkpoints::fEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(AddMempoolTransactions_packages)
+{
+    CTxMemPool pool(CFeeRate(0));
+    LOCK2(cs_main, pool.cs);
+
+    // A cheap parent paid for by its child, a transaction in between, one below the relay fee
+    // and a well paying one whose input does not exist
+    CMutableTransaction tx1 = MempoolTestTx(uint256(1));
+    CMutableTransaction tx2 = MempoolTestTx(uint256(2));
+    CMutableTransaction tx3 = MempoolTestTx(tx2.GetHash());
+    CMutableTransaction tx4 = MempoolTestTx(uint256(4));
+    CMutableTransaction tx5 = MempoolTestTx(uint256(5));
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 5000, GetTime(), 0.0, 1, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 0, GetTime(), 0.0, 1, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 20000, GetTime(), 0.0, 1, 1));
+    pool.addUnchecked(tx4.GetHash(), CTxMemPoolEntry(tx4, 1, GetTime(), 0.0, 1, 1));
+    pool.addUnchecked(tx5.GetHash(), CTxMemPoolEntry(tx5, 50000, GetTime(), 0.0, 1, 1));
+
+    CCoinsViewCache view(pcoinsTip);
+    Coin coin(CTxOut(10 * COIN, CScript() << OP_11 << OP_EQUAL), 1, false, false);
+    view.AddCoin(COutPoint(uint256(1), 0), coin, false);
+    view.AddCoin(COutPoint(uint256(2), 0), coin, false);
+    view.AddCoin(COutPoint(uint256(4), 0), coin, false);
+
+    CBlockTemplate blocktemplate;
+    BOOST_CHECK_EQUAL(AddMempoolTransactions(&blocktemplate, pool, &view, 1), 25000);
+    BOOST_CHECK_EQUAL(blocktemplate.block.vtx.size(), 3U);
+    BOOST_CHECK(blocktemplate.block.vtx[0].GetHash() == tx2.GetHash());
+    BOOST_CHECK(blocktemplate.block.vtx[1].GetHash() == tx3.GetHash());
+    BOOST_CHECK(blocktemplate.block.vtx[2].GetHash() == tx1.GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
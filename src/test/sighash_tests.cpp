@@ -160,6 +160,41 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    seed_insecure_rand(false);
+
+    // Input counts around PRECOMPUTE_MIN_INPUTS and the 253-entry compact size boundary
+    const unsigned int vInputs[] = {1, PRECOMPUTE_MIN_INPUTS - 1, PRECOMPUTE_MIN_INPUTS, 20, 252, 253, 300};
+    for (unsigned int n = 0; n < sizeof(vInputs) / sizeof(vInputs[0]); n++) {
+        for (int i = 0; i < 10; i++) {
+            CMutableTransaction txMut;
+            RandomTransaction(txMut, false);
+            txMut.vin.resize(1);
+            while (txMut.vin.size() < vInputs[n]) {
+                CTxIn txin = txMut.vin[0];
+                txin.prevout.hash = GetRandHash();
+                txin.nSequence = insecure_rand();
+                txMut.vin.push_back(txin);
+            }
+            // Enough outputs that SIGHASH_SINGLE is defined for every input
+            while (txMut.vout.size() < txMut.vin.size())
+                txMut.vout.push_back(txMut.vout[0]);
+            CTransaction txTo(txMut);
+            PrecomputedTransactionData txdata(txTo);
+            BOOST_CHECK_EQUAL(txdata.vHashPrefix.size(), txTo.vin.size() >= PRECOMPUTE_MIN_INPUTS ? txTo.vin.size() : 0);
+
+            for (unsigned int nIn = 0; nIn < txTo.vin.size(); nIn++) {
+                CScript scriptCode;
+                RandomScript(scriptCode);
+                // Every hash type behaves as SIGHASH_ALL unless it is NONE, SINGLE or ANYONECANPAY
+                int nHashType = (insecure_rand() % 4) ? (insecure_rand() & 0x7f) : insecure_rand();
+                BOOST_CHECK(SignatureHash(scriptCode, txTo, nIn, nHashType, &txdata) == SignatureHashOld(scriptCode, txTo, nIn, nHashType));
+            }
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
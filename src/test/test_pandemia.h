@@ -0,0 +1,14 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TEST_TEST_PANDEMIA_H
+#define BITCOIN_TEST_TEST_PANDEMIA_H
+
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+/** A transaction spending output 0 of hashPrev to one 10 COIN output, which a child made the same way can spend */
+CMutableTransaction MempoolTestTx(const uint256& hashPrev);
+
+#endif // BITCOIN_TEST_TEST_PANDEMIA_H
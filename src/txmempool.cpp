@@ -7,26 +7,42 @@
 #include "txmempool.h"
 
 #include "clientversion.h"
+#include "core_memusage.h"
 #include "main.h"
 #include "streams.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "version.h"
 
+#include <cmath>
+
 #include <boost/circular_buffer.hpp>
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0),
+                                     nSigOpCount(0), feeDelta(0),
+                                     nCountWithDescendants(0), nSizeWithDescendants(0), nFeesWithDescendants(0),
+                                     nCountWithAncestors(0), nSizeWithAncestors(0), nModFeesWithAncestors(0), nSigOpCountWithAncestors(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight, unsigned int _nSigOpCount) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nSigOpCount(_nSigOpCount), feeDelta(0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+    nUsageSize = RecursiveDynamicUsage(tx);
+
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
+    nFeesWithDescendants = nFee;
+
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nModFeesWithAncestors = nFee;
+    nSigOpCountWithAncestors = nSigOpCount;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -34,6 +50,72 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
     *this = other;
 }
 
+void CTxMemPoolEntry::UpdateFeeDelta(CAmount newFeeDelta)
+{
+    nFeesWithDescendants += newFeeDelta - feeDelta;
+    nModFeesWithAncestors += newFeeDelta - feeDelta;
+    feeDelta = newFeeDelta;
+}
+
+void CTxMemPoolEntry::UpdateDescendantState(int64_t nSizeDelta, CAmount nFeeDelta, int64_t nCountDelta)
+{
+    nSizeWithDescendants += nSizeDelta;
+    nFeesWithDescendants += nFeeDelta;
+    nCountWithDescendants += nCountDelta;
+}
+
+void CTxMemPoolEntry::SetDescendantState(uint64_t nSize, CAmount nFee, uint64_t nCount)
+{
+    nSizeWithDescendants = nSize;
+    nFeesWithDescendants = nFee;
+    nCountWithDescendants = nCount;
+}
+
+void CTxMemPoolEntry::UpdateAncestorState(int64_t nSizeDelta, CAmount nFeeDelta, int64_t nCountDelta, int nSigOpsDelta)
+{
+    nSizeWithAncestors += nSizeDelta;
+    nModFeesWithAncestors += nFeeDelta;
+    nCountWithAncestors += nCountDelta;
+    nSigOpCountWithAncestors += nSigOpsDelta;
+}
+
+void CTxMemPoolEntry::SetAncestorState(uint64_t nSize, CAmount nFee, uint64_t nCount, unsigned int nSigOps)
+{
+    nSizeWithAncestors = nSize;
+    nModFeesWithAncestors = nFee;
+    nCountWithAncestors = nCount;
+    nSigOpCountWithAncestors = nSigOps;
+}
+
+CTxMemPoolScore::CTxMemPoolScore(const uint256& hashIn, const CTxMemPoolEntry& entry) : hash(hashIn)
+{
+    // Compare fee / size without dividing: use the package if it pays a better rate
+    if ((double)entry.GetFeesWithDescendants() * entry.GetTxSize() > (double)entry.GetModifiedFee() * entry.GetSizeWithDescendants()) {
+        nFee = entry.GetFeesWithDescendants();
+        nSize = entry.GetSizeWithDescendants();
+    } else {
+        nFee = entry.GetModifiedFee();
+        nSize = entry.GetTxSize();
+    }
+}
+
+CTxMemPoolAncestorScore::CTxMemPoolAncestorScore(const uint256& hashIn, const CTxMemPoolEntry& entry) : hash(hashIn)
+{
+    *this = CTxMemPoolAncestorScore(hashIn, entry.GetModifiedFee(), entry.GetTxSize(), entry.GetModFeesWithAncestors(), entry.GetSizeWithAncestors());
+}
+
+CTxMemPoolAncestorScore::CTxMemPoolAncestorScore(const uint256& hashIn, CAmount nModFee, uint64_t nTxSize, CAmount nModFeesWithAncestors, uint64_t nSizeWithAncestors) : hash(hashIn)
+{
+    // Use the package if it pays a worse rate than the transaction alone
+    if ((double)nModFeesWithAncestors * nTxSize < (double)nModFee * nSizeWithAncestors) {
+        nFee = nModFeesWithAncestors;
+        nSize = nSizeWithAncestors;
+    } else {
+        nFee = nModFee;
+        nSize = nTxSize;
+    }
+}
+
 double
 CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
@@ -356,7 +438,12 @@ public:
 
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
-                                                       minRelayFee(_minRelayFee)
+                                                       minRelayFee(_minRelayFee),
+                                                       totalTxSize(0),
+                                                       cachedInnerUsage(0),
+                                                       lastRollingFeeUpdate(GetTime()),
+                                                       blockSinceLastRollingFeeBump(false),
+                                                       rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -376,17 +463,10 @@ CTxMemPool::~CTxMemPool()
     delete minerPolicyEstimator;
 }
 
-void CTxMemPool::pruneSpent(const uint256& hashTx, CCoins& coins)
+bool CTxMemPool::isSpent(const COutPoint& outpoint)
 {
     LOCK(cs);
-
-    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(COutPoint(hashTx, 0));
-
-    // iterate over all COutPoints in mapNextTx whose hash equals the provided hashTx
-    while (it != mapNextTx.end() && it->first.hash == hashTx) {
-        coins.Spend(it->first.n); // and remove those outputs from coins
-        it++;
-    }
+    return mapNextTx.count(outpoint);
 }
 
 unsigned int CTxMemPool::GetTransactionsUpdated() const
@@ -402,6 +482,120 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+void CTxMemPool::CalculateAncestors(const CTransaction& tx, std::set<uint256>& setAncestors) const
+{
+    std::deque<const CTransaction*> txToVisit;
+    txToVisit.push_back(&tx);
+    while (!txToVisit.empty()) {
+        const CTransaction* ptx = txToVisit.front();
+        txToVisit.pop_front();
+        BOOST_FOREACH (const CTxIn& txin, ptx->vin) {
+            std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.find(txin.prevout.hash);
+            if (it != mapTx.end() && setAncestors.insert(it->first).second)
+                txToVisit.push_back(&it->second.GetTx());
+        }
+    }
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, std::set<uint256>& setAncestors, uint64_t limitAncestorCount,
+    uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString) const
+{
+    uint64_t nSizeWithAncestors = entry.GetTxSize();
+    std::deque<const CTransaction*> txToVisit;
+    txToVisit.push_back(&entry.GetTx());
+    while (!txToVisit.empty()) {
+        const CTransaction* ptx = txToVisit.front();
+        txToVisit.pop_front();
+        BOOST_FOREACH (const CTxIn& txin, ptx->vin) {
+            std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.find(txin.prevout.hash);
+            if (it == mapTx.end() || !setAncestors.insert(it->first).second)
+                continue;
+            const CTxMemPoolEntry& ancestor = it->second;
+            if (ancestor.GetCountWithDescendants() + 1 > limitDescendantCount) {
+                errString = strprintf("too many descendants for tx %s [limit: %u]", it->first.ToString(), limitDescendantCount);
+                return false;
+            }
+            if (ancestor.GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
+                errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", it->first.ToString(), limitDescendantSize);
+                return false;
+            }
+            if (setAncestors.size() + 1 > limitAncestorCount) {
+                errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+                return false;
+            }
+            nSizeWithAncestors += ancestor.GetTxSize();
+            if (nSizeWithAncestors > limitAncestorSize) {
+                errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+                return false;
+            }
+            txToVisit.push_back(&ancestor.GetTx());
+        }
+    }
+    return true;
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    std::deque<uint256> txToVisit;
+    txToVisit.push_back(hash);
+    while (!txToVisit.empty()) {
+        uint256 hashTx = txToVisit.front();
+        txToVisit.pop_front();
+        std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.lower_bound(COutPoint(hashTx, 0));
+        for (; it != mapNextTx.end() && it->first.hash == hashTx; it++) {
+            const uint256& hashChild = it->second.ptx->GetHash();
+            if (setDescendants.insert(hashChild).second)
+                txToVisit.push_back(hashChild);
+        }
+    }
+}
+
+void CTxMemPool::UpdateDescendants(std::map<uint256, CTxMemPoolEntry>::iterator it, int64_t nSizeDelta, CAmount nFeeDelta, int64_t nCountDelta)
+{
+    setTxByScore.erase(CTxMemPoolScore(it->first, it->second));
+    it->second.UpdateDescendantState(nSizeDelta, nFeeDelta, nCountDelta);
+    setTxByScore.insert(CTxMemPoolScore(it->first, it->second));
+}
+
+void CTxMemPool::UpdateDescendantsFromScratch(std::map<uint256, CTxMemPoolEntry>::iterator it)
+{
+    std::set<uint256> setDescendants;
+    CalculateDescendants(it->first, setDescendants);
+    uint64_t nSize = it->second.GetTxSize();
+    CAmount nFee = it->second.GetModifiedFee();
+    BOOST_FOREACH (const uint256& hash, setDescendants) {
+        const CTxMemPoolEntry& entry = mapTx.find(hash)->second;
+        nSize += entry.GetTxSize();
+        nFee += entry.GetModifiedFee();
+    }
+    setTxByScore.erase(CTxMemPoolScore(it->first, it->second));
+    it->second.SetDescendantState(nSize, nFee, setDescendants.size() + 1);
+    setTxByScore.insert(CTxMemPoolScore(it->first, it->second));
+}
+
+void CTxMemPool::UpdateAncestors(std::map<uint256, CTxMemPoolEntry>::iterator it, int64_t nSizeDelta, CAmount nFeeDelta, int64_t nCountDelta, int nSigOpsDelta)
+{
+    setTxByAncestorScore.erase(CTxMemPoolAncestorScore(it->first, it->second));
+    it->second.UpdateAncestorState(nSizeDelta, nFeeDelta, nCountDelta, nSigOpsDelta);
+    setTxByAncestorScore.insert(CTxMemPoolAncestorScore(it->first, it->second));
+}
+
+void CTxMemPool::UpdateAncestorsFromScratch(std::map<uint256, CTxMemPoolEntry>::iterator it, const std::set<uint256>& setAncestors)
+{
+    uint64_t nSize = it->second.GetTxSize();
+    CAmount nFee = it->second.GetModifiedFee();
+    unsigned int nSigOps = it->second.GetSigOpCount();
+    BOOST_FOREACH (const uint256& hash, setAncestors) {
+        const CTxMemPoolEntry& entry = mapTx.find(hash)->second;
+        nSize += entry.GetTxSize();
+        nFee += entry.GetModifiedFee();
+        nSigOps += entry.GetSigOpCount();
+    }
+    setTxByAncestorScore.erase(CTxMemPoolAncestorScore(it->first, it->second));
+    it->second.SetAncestorState(nSize, nFee, setAncestors.size() + 1, nSigOps);
+    setTxByAncestorScore.insert(CTxMemPoolAncestorScore(it->first, it->second));
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
 {
     // Add to memory pool without checking anything.
@@ -409,12 +603,42 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
+        std::map<uint256, CTxMemPoolEntry>::iterator itNew = mapTx.insert(std::make_pair(hash, entry)).first;
+        const CTransaction& tx = itNew->second.GetTx();
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator itDelta = mapDeltas.find(hash);
+        if (itDelta != mapDeltas.end())
+            itNew->second.UpdateFeeDelta(itDelta->second.second);
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
+        cachedInnerUsage += entry.DynamicMemoryUsage();
+        setTxByScore.insert(CTxMemPoolScore(hash, itNew->second));
+        setTxByAncestorScore.insert(CTxMemPoolAncestorScore(hash, itNew->second));
+        setTxByTime.insert(std::make_pair(entry.GetTime(), hash));
+
+        std::set<uint256> setAncestors;
+        CalculateAncestors(tx, setAncestors);
+        UpdateAncestorsFromScratch(itNew, setAncestors);
+        std::map<COutPoint, CInPoint>::iterator itChild = mapNextTx.lower_bound(COutPoint(hash, 0));
+        if (itChild != mapNextTx.end() && itChild->first.hash == hash) {
+            // A transaction from a disconnected block that already has children in the pool,
+            // recount the packages it now joins
+            UpdateDescendantsFromScratch(itNew);
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors)
+                UpdateDescendantsFromScratch(mapTx.find(hashAncestor));
+            std::set<uint256> setDescendants;
+            CalculateDescendants(hash, setDescendants);
+            BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+                std::map<uint256, CTxMemPoolEntry>::iterator itDescendant = mapTx.find(hashDescendant);
+                std::set<uint256> setDescendantAncestors;
+                CalculateAncestors(itDescendant->second.GetTx(), setDescendantAncestors);
+                UpdateAncestorsFromScratch(itDescendant, setDescendantAncestors);
+            }
+        } else {
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors)
+                UpdateDescendants(mapTx.find(hashAncestor), itNew->second.GetTxSize(), itNew->second.GetModifiedFee(), 1);
+        }
     }
     return true;
 }
@@ -439,26 +663,55 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                 txToRemove.push_back(it->second.ptx->GetHash());
             }
         }
+
+        // Collect everything first, so that ancestors staying in the pool can be
+        // reached while their descendant state is updated
+        std::vector<uint256> vRemove;
+        std::set<uint256> setRemove;
         while (!txToRemove.empty()) {
             uint256 hash = txToRemove.front();
             txToRemove.pop_front();
-            if (!mapTx.count(hash))
+            if (!mapTx.count(hash) || !setRemove.insert(hash).second)
                 continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
+            vRemove.push_back(hash);
             if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-                    if (it == mapNextTx.end())
-                        continue;
+                std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(COutPoint(hash, 0));
+                for (; it != mapNextTx.end() && it->first.hash == hash; it++)
                     txToRemove.push_back(it->second.ptx->GetHash());
-                }
             }
+        }
+
+        BOOST_FOREACH (const uint256& hash, vRemove) {
+            const CTxMemPoolEntry& entry = mapTx[hash];
+            std::set<uint256> setAncestors;
+            CalculateAncestors(entry.GetTx(), setAncestors);
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+                if (!setRemove.count(hashAncestor))
+                    UpdateDescendants(mapTx.find(hashAncestor), -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee(), -1);
+            }
+            // Children of a mined transaction stay behind with a smaller package
+            std::set<uint256> setDescendants;
+            if (!fRecursive)
+                CalculateDescendants(hash, setDescendants);
+            BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+                if (!setRemove.count(hashDescendant))
+                    UpdateAncestors(mapTx.find(hashDescendant), -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee(), -1, -(int)entry.GetSigOpCount());
+            }
+        }
+
+        BOOST_FOREACH (const uint256& hash, vRemove) {
+            std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+            const CTransaction& tx = it->second.GetTx();
             BOOST_FOREACH (const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
 
             removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
-            mapTx.erase(hash);
+            totalTxSize -= it->second.GetTxSize();
+            cachedInnerUsage -= it->second.DynamicMemoryUsage();
+            setTxByScore.erase(CTxMemPoolScore(hash, it->second));
+            setTxByAncestorScore.erase(CTxMemPoolAncestorScore(hash, it->second));
+            setTxByTime.erase(std::make_pair(it->second.GetTime(), hash));
+            mapTx.erase(it);
             nTransactionsUpdated++;
         }
     }
@@ -475,9 +728,9 @@ void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned in
             std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end())
                 continue;
-            const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
-            if (fSanityCheck) assert(coins);
-            if (!coins || ((coins->IsCoinBase() || coins->IsCoinStake()) && nMemPoolHeight - coins->nHeight < (unsigned)Params().COINBASE_MATURITY())) {
+            const Coin& coin = pcoins->AccessCoin(txin.prevout);
+            if (fSanityCheck) assert(!coin.IsSpent());
+            if (coin.IsSpent() || ((coin.IsCoinBase() || coin.IsCoinStake()) && nMemPoolHeight - coin.nHeight < (unsigned)Params().COINBASE_MATURITY())) {
                 transactionsToRemove.push_back(tx);
                 break;
             }
@@ -524,6 +777,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 
@@ -532,7 +787,14 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    setTxByScore.clear();
+    setTxByAncestorScore.clear();
+    setTxByTime.clear();
     totalTxSize = 0;
+    cachedInnerUsage = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
 }
 
@@ -544,6 +806,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     LogPrint("mempool", "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
     uint64_t checkTotal = 0;
+    uint64_t innerUsage = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
 
@@ -552,7 +815,40 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
         checkTotal += it->second.GetTxSize();
+        innerUsage += it->second.DynamicMemoryUsage();
         const CTransaction& tx = it->second.GetTx();
+
+        // Check the descendant state against a full recount
+        std::set<uint256> setDescendants;
+        CalculateDescendants(it->first, setDescendants);
+        uint64_t nSizeCheck = it->second.GetTxSize();
+        CAmount nFeesCheck = it->second.GetModifiedFee();
+        BOOST_FOREACH (const uint256& hash, setDescendants) {
+            nSizeCheck += mapTx.find(hash)->second.GetTxSize();
+            nFeesCheck += mapTx.find(hash)->second.GetModifiedFee();
+        }
+        assert(it->second.GetCountWithDescendants() == setDescendants.size() + 1);
+        assert(it->second.GetSizeWithDescendants() == nSizeCheck);
+        assert(it->second.GetFeesWithDescendants() == nFeesCheck);
+        assert(setTxByScore.count(CTxMemPoolScore(it->first, it->second)));
+
+        // ... and the ancestor state
+        std::set<uint256> setAncestors;
+        CalculateAncestors(tx, setAncestors);
+        nSizeCheck = it->second.GetTxSize();
+        nFeesCheck = it->second.GetModifiedFee();
+        unsigned int nSigOpsCheck = it->second.GetSigOpCount();
+        BOOST_FOREACH (const uint256& hash, setAncestors) {
+            nSizeCheck += mapTx.find(hash)->second.GetTxSize();
+            nFeesCheck += mapTx.find(hash)->second.GetModifiedFee();
+            nSigOpsCheck += mapTx.find(hash)->second.GetSigOpCount();
+        }
+        assert(it->second.GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->second.GetSizeWithAncestors() == nSizeCheck);
+        assert(it->second.GetModFeesWithAncestors() == nFeesCheck);
+        assert(it->second.GetSigOpCountWithAncestors() == nSigOpsCheck);
+        assert(setTxByAncestorScore.count(CTxMemPoolAncestorScore(it->first, it->second)));
+
         bool fDependsWait = false;
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
@@ -562,8 +858,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
             } else {
-                const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
-                assert(coins && coins->IsAvailable(txin.prevout.n));
+                assert(pcoins->HaveCoin(txin.prevout));
             }
             // Check whether its inputs are marked in mapNextTx.
             std::map<COutPoint, CInPoint>::const_iterator it3 = mapNextTx.find(txin.prevout);
@@ -608,6 +903,91 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
 
     assert(totalTxSize == checkTotal);
+    assert(innerUsage == cachedInnerUsage);
+    assert(setTxByScore.size() == mapTx.size());
+    assert(setTxByAncestorScore.size() == mapTx.size());
+    assert(setTxByTime.size() == mapTx.size());
+}
+
+size_t CTxMemPool::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return memusage::DynamicUsage(mapTx) + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) +
+           memusage::DynamicUsage(setTxByScore) + memusage::DynamicUsage(setTxByAncestorScore) +
+           memusage::DynamicUsage(setTxByTime) + cachedInnerUsage;
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(llround(rollingMinimumFeeRate));
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        // Decay faster the emptier the pool is
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < minRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(llround(rollingMinimumFeeRate)), minRelayFee);
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit)
+{
+    LOCK(cs);
+
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        const CTxMemPoolScore& score = *setTxByScore.begin();
+
+        // Whatever comes in next has to pay more than the package we drop, plus
+        // the relay fee for the bandwidth the drop wasted
+        CFeeRate removedRate(score.GetFeeRate().GetFeePerK() + minRelayFee.GetFeePerK());
+        trackPackageRemoved(removedRate);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removedRate);
+
+        std::list<CTransaction> removed;
+        CTransaction tx = mapTx[score.hash].GetTx();
+        remove(tx, removed, true);
+        nTxnRemoved += removed.size();
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+}
+
+int CTxMemPool::Expire(int64_t time)
+{
+    LOCK(cs);
+    std::vector<CTransaction> vExpired;
+    for (std::set<std::pair<int64_t, uint256> >::iterator it = setTxByTime.begin(); it != setTxByTime.end() && it->first < time; it++)
+        vExpired.push_back(mapTx[it->second].GetTx());
+
+    std::list<CTransaction> removed;
+    BOOST_FOREACH (const CTransaction& tx, vExpired)
+        remove(tx, removed, true);
+    return removed.size();
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -678,6 +1058,25 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+
+        std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+        if (it != mapTx.end() && nFeeDelta != 0) {
+            // Move the transaction and every package it belongs to
+            setTxByScore.erase(CTxMemPoolScore(hash, it->second));
+            setTxByAncestorScore.erase(CTxMemPoolAncestorScore(hash, it->second));
+            it->second.UpdateFeeDelta(deltas.second);
+            setTxByScore.insert(CTxMemPoolScore(hash, it->second));
+            setTxByAncestorScore.insert(CTxMemPoolAncestorScore(hash, it->second));
+
+            std::set<uint256> setAncestors;
+            CalculateAncestors(it->second.GetTx(), setAncestors);
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors)
+                UpdateDescendants(mapTx.find(hashAncestor), 0, nFeeDelta, 0);
+            std::set<uint256> setDescendants;
+            CalculateDescendants(hash, setDescendants);
+            BOOST_FOREACH (const uint256& hashDescendant, setDescendants)
+                UpdateAncestors(mapTx.find(hashDescendant), 0, nFeeDelta, 0, 0);
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -702,20 +1101,23 @@ void CTxMemPool::ClearPrioritisation(const uint256 hash)
 
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) {}
 
-bool CCoinsViewMemPool::GetCoins(const uint256& txid, CCoins& coins) const
+bool CCoinsViewMemPool::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
-    // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
-    // transactions. First checking the underlying cache risks returning a pruned entry instead.
+    // conflict with the underlying cache, and it cannot have spent entries (as it contains full)
+    // transactions. First checking the underlying cache risks returning a spent entry instead.
     CTransaction tx;
-    if (mempool.lookup(txid, tx)) {
-        coins = CCoins(tx, MEMPOOL_HEIGHT);
+    if (mempool.lookup(outpoint.hash, tx)) {
+        if (outpoint.n >= tx.vout.size())
+            return false;
+        coin = Coin(tx.vout[outpoint.n], MEMPOOL_HEIGHT, false, false);
         return true;
     }
-    return (base->GetCoins(txid, coins) && !coins.IsPruned());
+    return base->GetCoin(outpoint, coin);
 }
 
-bool CCoinsViewMemPool::HaveCoins(const uint256& txid) const
+bool CCoinsViewMemPool::HaveCoin(const COutPoint& outpoint) const
 {
-    return mempool.exists(txid) || base->HaveCoins(txid);
+    Coin coin;
+    return GetCoin(outpoint, coin);
 }
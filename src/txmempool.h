@@ -8,6 +8,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -29,9 +30,12 @@ inline bool AllowFree(double dPriority)
 }
 
 
-/** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
+/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Half life in seconds of the rolling minimum fee once the pool has shrunk */
+static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
 /**
  * CTxMemPool stores these:
  */
@@ -42,12 +46,27 @@ private:
     CAmount nFee;         //! Cached to avoid expensive parent-transaction lookups
     size_t nTxSize;       //! ... and avoid recomputing tx size
     size_t nModSize;      //! ... and modified size for priority
+    size_t nUsageSize;    //! ... and total memory usage
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    unsigned int nSigOpCount; //! Legacy and P2SH sigops
+    CAmount feeDelta;     //! Fee delta from PrioritiseTransaction
+
+    // Information about this transaction together with all its in-mempool descendants,
+    // maintained by CTxMemPool. Fees include the PrioritiseTransaction deltas.
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nFeesWithDescendants;
+
+    // ... and together with all its in-mempool ancestors, the package a block has to include
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
 
 public:
-    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
+    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight, unsigned int _nSigOpCount);
     CTxMemPoolEntry();
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
@@ -57,6 +76,77 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    size_t DynamicMemoryUsage() const { return nUsageSize; }
+    unsigned int GetSigOpCount() const { return nSigOpCount; }
+    CAmount GetModifiedFee() const { return nFee + feeDelta; }
+    /** Replace the PrioritiseTransaction delta, the package totals follow */
+    void UpdateFeeDelta(CAmount newFeeDelta);
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetFeesWithDescendants() const { return nFeesWithDescendants; }
+    void UpdateDescendantState(int64_t nSizeDelta, CAmount nFeeDelta, int64_t nCountDelta);
+    void SetDescendantState(uint64_t nSize, CAmount nFee, uint64_t nCount);
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    unsigned int GetSigOpCountWithAncestors() const { return nSigOpCountWithAncestors; }
+    void UpdateAncestorState(int64_t nSizeDelta, CAmount nFeeDelta, int64_t nCountDelta, int nSigOpsDelta);
+    void SetAncestorState(uint64_t nSize, CAmount nFee, uint64_t nCount, unsigned int nSigOps);
+};
+
+/**
+ * Position of a transaction in the eviction order: the higher of its own fee rate and
+ * the fee rate of its package with all in-mempool descendants, so that a cheap parent
+ * paid for by its children is not evicted before them.
+ */
+class CTxMemPoolScore
+{
+public:
+    CAmount nFee;
+    uint64_t nSize;
+    uint256 hash;
+
+    CTxMemPoolScore(const uint256& hashIn, const CTxMemPoolEntry& entry);
+
+    CFeeRate GetFeeRate() const { return CFeeRate(nFee, nSize); }
+
+    bool operator<(const CTxMemPoolScore& b) const
+    {
+        // Doubles avoid overflowing fee * size
+        double f1 = (double)nFee * b.nSize;
+        double f2 = (double)b.nFee * nSize;
+        if (f1 == f2)
+            return hash < b.hash;
+        return f1 < f2;
+    }
+};
+
+/**
+ * Position of a transaction in the block template order: the lower of its own fee rate
+ * and the fee rate of its package with all ancestors not yet in the block, best first.
+ * A parent paid for by its child is mined with it; a rich child does not drag in a
+ * poor package ahead of better ones.
+ */
+class CTxMemPoolAncestorScore
+{
+public:
+    CAmount nFee;
+    uint64_t nSize;
+    uint256 hash;
+
+    CTxMemPoolAncestorScore(const uint256& hashIn, const CTxMemPoolEntry& entry);
+    CTxMemPoolAncestorScore(const uint256& hashIn, CAmount nModFee, uint64_t nTxSize, CAmount nModFeesWithAncestors, uint64_t nSizeWithAncestors);
+
+    bool operator<(const CTxMemPoolAncestorScore& b) const
+    {
+        double f1 = (double)nFee * b.nSize;
+        double f2 = (double)b.nFee * nSize;
+        if (f1 == f2)
+            return hash < b.hash;
+        return f1 > f2;
+    }
 };
 
 class CMinerPolicyEstimator;
@@ -101,12 +191,29 @@ private:
 
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
+    uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+
+    std::set<CTxMemPoolScore> setTxByScore;                 //! eviction order, lowest score first
+    std::set<std::pair<int64_t, uint256> > setTxByTime;     //! expiry order, oldest first
+
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
+    /** Change an entry's descendant state and move it in the eviction order accordingly */
+    void UpdateDescendants(std::map<uint256, CTxMemPoolEntry>::iterator it, int64_t nSizeDelta, CAmount nFeeDelta, int64_t nCountDelta);
+    void UpdateDescendantsFromScratch(std::map<uint256, CTxMemPoolEntry>::iterator it);
+    /** Change an entry's ancestor state and move it in the block template order accordingly */
+    void UpdateAncestors(std::map<uint256, CTxMemPoolEntry>::iterator it, int64_t nSizeDelta, CAmount nFeeDelta, int64_t nCountDelta, int nSigOpsDelta);
+    void UpdateAncestorsFromScratch(std::map<uint256, CTxMemPoolEntry>::iterator it, const std::set<uint256>& setAncestors);
+    void trackPackageRemoved(const CFeeRate& rate);
 
 public:
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::set<CTxMemPoolAncestorScore> setTxByAncestorScore; //! block template order, best package first
 
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
@@ -120,6 +227,19 @@ public:
     void check(const CCoinsViewCache* pcoins) const;
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
+    /** In-mempool transactions tx depends on, directly or not. Requires cs. */
+    void CalculateAncestors(const CTransaction& tx, std::set<uint256>& setAncestors) const;
+    /**
+     * In-mempool ancestors of a transaction about to enter the pool, like CalculateAncestors. Fails,
+     * with errString set, as soon as the transaction with its ancestors would exceed limitAncestorCount
+     * transactions or limitAncestorSize bytes, or any ancestor with its descendants would exceed
+     * limitDescendantCount transactions or limitDescendantSize bytes. Requires cs.
+     */
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, std::set<uint256>& setAncestors, uint64_t limitAncestorCount,
+        uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString) const;
+    /** In-mempool transactions depending on hash, directly or not. Requires cs. */
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
     void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight);
@@ -127,7 +247,8 @@ public:
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
-    void pruneSpent(const uint256& hash, CCoins& coins);
+    //! Whether a mempool transaction spends the outpoint
+    bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
 
@@ -136,6 +257,21 @@ public:
     void ApplyDeltas(const uint256 hash, double& dPriorityDelta, CAmount& nFeeDelta);
     void ClearPrioritisation(const uint256 hash);
 
+    /**
+     * The minimum fee to get into the mempool, which may itself not be enough
+     * for larger-sized transactions. Rises when transactions are evicted to stay
+     * under sizelimit and decays back to zero with a half life of ROLLING_FEE_HALFLIFE.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
+    /** Evict the lowest scoring transactions, with their descendants, until the pool uses at most sizelimit bytes */
+    void TrimToSize(size_t sizelimit);
+
+    /** Remove transactions that entered the pool before time, with their descendants. Returns the number removed. */
+    int Expire(int64_t time);
+
+    size_t DynamicMemoryUsage() const;
+
     unsigned long size()
     {
         LOCK(cs);
@@ -177,8 +313,8 @@ protected:
 
 public:
     CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn);
-    bool GetCoins(const uint256& txid, CCoins& coins) const;
-    bool HaveCoins(const uint256& txid) const;
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
 };
 
 #endif // BITCOIN_TXMEMPOOL_H
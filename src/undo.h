@@ -6,27 +6,31 @@
 #ifndef BITCOIN_UNDO_H
 #define BITCOIN_UNDO_H
 
+#include "coins.h"
 #include "compressor.h"
 #include "primitives/transaction.h"
 #include "serialize.h"
 
 /** Undo information for a CTxIn
  *
- *  Contains the prevout's CTxOut being spent, and if this was the
- *  last output of the affected transaction, its metadata as well
- *  (coinbase or not, height, transaction version)
+ *  Contains the prevout's CTxOut being spent and its metadata (coinbase or
+ *  not, height). Undo data written before coins were stored per output only
+ *  carries the metadata for the last spent output of a transaction, and has
+ *  nHeight == 0 otherwise. The transaction version is no longer tracked and
+ *  is written as 0.
  */
 class CTxInUndo
 {
 public:
     CTxOut txout;   // the txout data before being spent
-    bool fCoinBase; // if the outpoint was the last unspent: whether it belonged to a coinbase
+    bool fCoinBase; // whether it belonged to a coinbase
     bool fCoinStake;
-    unsigned int nHeight; // if the outpoint was the last unspent: its height
-    int nVersion;         // if the outpoint was the last unspent: its version
+    unsigned int nHeight; // its height, 0 if unknown (legacy undo data)
+    int nVersion;         // unused, kept for the serialization format
 
     CTxInUndo() : txout(), fCoinBase(false), fCoinStake(false), nHeight(0), nVersion(0) {}
     CTxInUndo(const CTxOut& txoutIn, bool fCoinBaseIn = false, bool fCoinStakeIn = false, unsigned int nHeightIn = 0, int nVersionIn = 0) : txout(txoutIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn), nVersion(nVersionIn) {}
+    explicit CTxInUndo(const Coin& coin) : txout(coin.out), fCoinBase(coin.fCoinBase), fCoinStake(coin.fCoinStake), nHeight(coin.nHeight), nVersion(0) {}
 
     unsigned int GetSerializeSize(int nType, int nVersion) const
     {
@@ -744,6 +744,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         // Break debit/credit balance caches:
         wtx.MarkDirty();
 
+        // Track new outputs and drop the ones this transaction spends
+        UpdateStakeableCoins(wtx);
+
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -787,11 +790,79 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
         return; // Not one of ours
 
     // If a transaction changes 'conflicted' state, that changes the balance
-    // available of the outputs it spends. So force those to be
-    // recomputed, also:
+    // available of the outputs it spends, and whether they can stake. So force
+    // those to be recomputed, also:
     BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-        if (mapWallet.count(txin.prevout.hash))
-            mapWallet[txin.prevout.hash].MarkDirty();
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+        if (mi == mapWallet.end())
+            continue;
+        mi->second.MarkDirty();
+        if (txin.prevout.n < mi->second.vout.size())
+            UpdateStakeableCoin(mi->second, txin.prevout.n);
+    }
+}
+
+void CWallet::EraseStakeableCoin(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet); // mapStakeableCoins
+    map<COutPoint, int64_t>::iterator mi = mapStakeableCoins.find(outpoint);
+    if (mi == mapStakeableCoins.end())
+        return;
+    setStakeableCoins.erase(make_pair(mi->second, outpoint));
+    mapStakeableCoins.erase(mi);
+}
+
+/**
+ * Re-evaluate whether an output belongs in the stakeable set. Only properties that
+ * change through wallet events are checked here; depth, age and finality depend on
+ * the chain and are checked by SelectStakeCoins when it walks the set.
+ */
+void CWallet::UpdateStakeableCoin(const CWalletTx& wtx, unsigned int n)
+{
+    AssertLockHeld(cs_main);   // IsSpent
+    AssertLockHeld(cs_wallet); // mapStakeableCoins, mapTxSpends, setLockedCoins
+    COutPoint outpoint(wtx.GetHash(), n);
+    EraseStakeableCoin(outpoint);
+
+    const CTxOut& txout = wtx.vout[n];
+    if (txout.nValue <= 0 || IsMine(txout) != ISMINE_SPENDABLE)
+        return;
+    if (IsLockedCoin(outpoint.hash, n))
+        return;
+
+    // Conflicted spenders do not count, as in IsSpent; SyncTransaction re-evaluates
+    // the prevouts of a spender when it becomes conflicted
+    if (IsSpent(outpoint.hash, n))
+        return;
+
+    int64_t nStakeableTime = wtx.GetTxTime() + nStakeMinAge;
+    mapStakeableCoins.insert(make_pair(outpoint, nStakeableTime));
+    setStakeableCoins.insert(make_pair(nStakeableTime, outpoint));
+}
+
+void CWallet::UpdateStakeableCoins(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+        UpdateStakeableCoin(wtx, i);
+
+    if (wtx.IsCoinBase())
+        return;
+    BOOST_FOREACH (const CTxIn& txin, wtx.vin) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        if (mi != mapWallet.end() && txin.prevout.n < mi->second.vout.size())
+            UpdateStakeableCoin(mi->second, txin.prevout.n);
+    }
+}
+
+void CWallet::RebuildStakeableCoins()
+{
+    AssertLockHeld(cs_wallet);
+    setStakeableCoins.clear();
+    mapStakeableCoins.clear();
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        for (unsigned int i = 0; i < it->second.vout.size(); i++)
+            UpdateStakeableCoin(it->second, i);
     }
 }
 
@@ -801,8 +872,13 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            for (unsigned int i = 0; i < mi->second.vout.size(); i++)
+                EraseStakeableCoin(COutPoint(hash, i));
+            mapWallet.erase(mi);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
@@ -1068,7 +1144,10 @@ void CWalletTx::RelayWalletTransaction(std::string strCommand)
             LogPrintf("Relaying wtx %s\n", hash.ToString());
 
             if (strCommand == "ix") {
-                mapTxLockReq.insert(make_pair(hash, (CTransaction) * this));
+                {
+                    LOCK(cs_swifttx);
+                    mapTxLockReq.insert(make_pair(hash, (CTransaction) * this));
+                }
                 CreateNewLock(((CTransaction) * this));
                 RelayTransactionLockReq((CTransaction) * this, true);
             } else {
@@ -1349,26 +1428,43 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, un
 
 bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const
 {
-    vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS);
+    LOCK2(cs_main, cs_wallet);
     CAmount nAmountSelected = 0;
+    int64_t nNow = GetAdjustedTime();
+
+    for (std::set<std::pair<int64_t, COutPoint> >::const_iterator it = setStakeableCoins.begin(); it != setStakeableCoins.end(); ++it) {
+        //check for min age, the set is ordered by it so no later coin is old enough either
+        if (it->first > nNow)
+            break;
+
+        const COutPoint& outpoint = it->second;
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(outpoint.hash);
+        if (mi == mapWallet.end())
+            continue;
+        const CWalletTx* pcoin = &mi->second;
+        CAmount nValue = pcoin->vout[outpoint.n].nValue;
 
-    for (const COutput& out : vCoins) {
         //make sure not to outrun target amount
-        if (nAmountSelected + out.tx->vout[out.i].nValue > nTargetAmount)
+        if (nAmountSelected + nValue > nTargetAmount)
             continue;
 
-        //check for min age
-        if (GetAdjustedTime() - out.tx->GetTxTime() < nStakeMinAge)
+        if (!IsFinalTx(*pcoin))
+            continue;
+
+        if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
             continue;
 
         //check that it is matured
-        if (out.nDepth < (out.tx->IsCoinStake() ? Params().COINBASE_MATURITY() : 10))
+        int nDepth = pcoin->GetDepthInMainChain(false);
+        if (nDepth < (pcoin->IsCoinStake() ? Params().COINBASE_MATURITY() : 10))
+            continue;
+
+        if (IsSpent(outpoint.hash, outpoint.n))
             continue;
 
         //add to our stake set
-        setCoins.insert(make_pair(out.tx, out.i));
-        nAmountSelected += out.tx->vout[out.i].nValue;
+        setCoins.insert(make_pair(pcoin, outpoint.n));
+        nAmountSelected += nValue;
     }
     return true;
 }
@@ -1839,21 +1935,38 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (nBalance <= nReserveBalance)
         return false;
 
-    // presstab HyperStake - Initialize as static and don't update the set on every run of CreateCoinStake() in order to lighten resource use
-    static std::set<pair<const CWalletTx*, unsigned int> > setStakeCoins;
-    static int nLastStakeSetUpdate = 0;
-
-    if (GetTime() - nLastStakeSetUpdate > nStakeSetUpdateTime) {
-        setStakeCoins.clear();
-        if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance))
-            return false;
-
-        nLastStakeSetUpdate = GetTime();
-    }
+    // The stakeable set is maintained from wallet events, so selecting from it only walks coins that can stake
+    std::set<pair<const CWalletTx*, unsigned int> > setStakeCoins;
+    if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance))
+        return false;
 
     if (setStakeCoins.empty())
         return false;
 
+    // Kernel search candidates, prepared once per stake set and chain tip, and the wallet transaction behind each one
+    static std::set<pair<const CWalletTx*, unsigned int> > setKernelSearchCoins;
+    static CStakeKernelSearch kernelSearch;
+    static vector<const CWalletTx*> vKernelSearchTx;
+    static uint256 hashKernelSearchTip = 0;
+
+    // Stake modifiers depend on the chain after each coin's block, so rebuild the candidates on a new tip
+    if (setKernelSearchCoins != setStakeCoins || hashKernelSearchTip != chainActive.Tip()->GetBlockHash()) {
+        kernelSearch.Clear();
+        vKernelSearchTx.clear();
+        BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
+            BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
+            if (it == mapBlockIndex.end()) {
+                if (fDebug)
+                    LogPrintf("CreateCoinStake() failed to find block index \n");
+                continue;
+            }
+            if (kernelSearch.AddCandidate(it->second, COutPoint(pcoin.first->GetHash(), pcoin.second), pcoin.first->vout[pcoin.second].nValue))
+                vKernelSearchTx.push_back(pcoin.first);
+        }
+        setKernelSearchCoins.swap(setStakeCoins);
+        hashKernelSearchTip = chainActive.Tip()->GetBlockHash();
+    }
+
     vector<const CWalletTx*> vwtxPrev;
 
     CAmount nCredit = 0;
@@ -1863,87 +1976,69 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (GetAdjustedTime() <= chainActive.Tip()->nTime)
         MilliSleep(10000);
 
-    BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
-        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            if (fDebug)
-                LogPrintf("CreateCoinStake() failed to find block index \n");
+    size_t nSearchFrom = 0;
+    size_t nKernel = 0;
+    uint256 hashProofOfStake = 0;
+    while (kernelSearch.Search(nBits, GetAdjustedTime(), nHashDrift, nSearchFrom, boost::thread::hardware_concurrency(), nKernel, nTxNewTime, hashProofOfStake)) {
+        const CWalletTx* pcoin = vKernelSearchTx[nKernel];
+        unsigned int nOut = kernelSearch.Get(nKernel).prevout.n;
+        nSearchFrom = nKernel + 1;
+
+        //Double check that this will pass time requirements
+        if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
+            LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
             continue;
         }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
-
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
+        // Found a kernel
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : kernel found\n");
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
-
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin->vout[nOut].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+            LogPrintf("CreateCoinStake : failed to parse kernel\n");
+            break;
+        }
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
             if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+                LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+            break; // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            //convert to pay to public key type
+            CKey key;
+            if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
                 if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                break; // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
 
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        } else
+            scriptPubKeyOut = scriptPubKeyKernel;
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        txNew.vin.push_back(CTxIn(pcoin->GetHash(), nOut));
+        nCredit += pcoin->vout[nOut].nValue;
+        vwtxPrev.push_back(pcoin);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
-            const CBlockIndex* pIndex0 = chainActive.Tip();
-            uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
+        //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
+        const CBlockIndex* pIndex0 = chainActive.Tip();
+        uint64_t nTotalSize = pcoin->vout[nOut].nValue + GetBlockValue(pIndex0->nHeight);
 
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+        if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
-        }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
+        break; // if kernel is found stop searching
     }
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -1992,7 +2087,6 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     }
 
     // Successfully generated coinstake
-    nLastStakeSetUpdate = 0; //this will trigger stake set to repopulate next round
     return true;
 }
 
@@ -2106,6 +2200,12 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    // Transactions can load before the keys that own them, so index stakeable outputs afterwards
+    {
+        LOCK2(cs_main, cs_wallet);
+        RebuildStakeableCoins();
+    }
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -2526,18 +2626,28 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    EraseStakeableCoin(output);
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(output.hash);
+    if (mi != mapWallet.end() && output.n < mi->second.vout.size())
+        UpdateStakeableCoin(mi->second, output.n);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
-    setLockedCoins.clear();
+    std::set<COutPoint> setUnlocked;
+    setUnlocked.swap(setLockedCoins);
+    BOOST_FOREACH (const COutPoint& output, setUnlocked) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(output.hash);
+        if (mi != mapWallet.end() && output.n < mi->second.vout.size())
+            UpdateStakeableCoin(mi->second, output.n);
+    }
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -2991,6 +3101,7 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if (!fEnableSwiftTX) return -1;
 
     //compile consessus vote
+    LOCK(cs_swifttx);
     std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
     if (i != mapTxLocks.end()) {
         return (*i).second.CountSignatures();
@@ -3004,6 +3115,7 @@ bool CMerkleTx::IsTransactionLockTimedOut() const
     if (!fEnableSwiftTX) return 0;
 
     //compile consessus vote
+    LOCK(cs_swifttx);
     std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
     if (i != mapTxLocks.end()) {
         return GetTime() > (*i).second.nTimeout;
@@ -159,6 +159,18 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs that can stake once they are old and deep enough, keyed by the
+     * time they reach nStakeMinAge. Kept up to date as transactions are added,
+     * spent, locked or erased, so staking never has to scan the whole wallet.
+     */
+    std::set<std::pair<int64_t, COutPoint> > setStakeableCoins;
+    std::map<COutPoint, int64_t> mapStakeableCoins;
+    void UpdateStakeableCoin(const CWalletTx& wtx, unsigned int n);
+    void UpdateStakeableCoins(const CWalletTx& wtx);
+    void EraseStakeableCoin(const COutPoint& outpoint);
+    void RebuildStakeableCoins();
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -188,7 +200,6 @@ public:
     unsigned int nHashDrift;
     unsigned int nHashInterval;
     uint64_t nStakeSplitThreshold;
-    int nStakeSetUpdateTime;
 
     //MultiSend
     std::vector<std::pair<std::string, int> > vMultiSend;
@@ -238,7 +249,6 @@ public:
         nHashDrift = 45;
         nStakeSplitThreshold = 2000;
         nHashInterval = 22;
-        nStakeSetUpdateTime = 300; // 5 minutes
 
         //MultiSend
         vMultiSend.clear();